@@ -4,24 +4,27 @@ SET_CLIPP_ALIAS(cli);
 
 int main(int argc, const char** argv)
 {
-    // CLI::ArgParser parser;
-	cli::Option<int> opt{"answer", 'a', 42, "what is the answer?"};
-	cli::OptionBase* p = &opt;
-
-	// fmt::vformat()
+	cli::ArgParser parser;
+	auto answer = parser.addOption<int>("answer", 'a', 42, "what is the answer?");
+	auto verbose = parser.addFlag("verbose", 'v', "print more");
+	auto name = parser.addPositional<cli::String>("name", "world", "who to greet");
+	cli::OptionBase* p = answer;
 
 	try
 	{
-		fmt::print("{}\n", opt.get());
+		parser.parse(argc, argv);
+		fmt::print("hello {}\n", name->get());
+		fmt::print("{}\n", answer->get());
 		fmt::print("{}\n", p->get<int>());
 		fmt::print("{}\n", p->name());
 		fmt::print("{}\n", p->description());
-		fmt::print("{}\n", opt.shortName());
-		fmt::print("{0}:{1}:{0}\n", 'a', 'b');
+		fmt::print("{}\n", answer->shortName());
+		if (verbose->get())
+			fmt::print("{} given: {}\n", p->name(), p->given());
 	}
 	catch(const std::exception& e)
 	{
 		fmt::print("{}\n", e.what());
+		return 1;
 	}
-	
-}
\ No newline at end of file
+}
@@ -0,0 +1,88 @@
+#ifndef __CLIPP_ALLOCATIONS_HEADER__
+#define __CLIPP_ALLOCATIONS_HEADER__
+
+#include "defines.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+CLIPP_BEGIN
+
+/** @brief Part of a command line an allocation is made in, see `CLI::lineAllocations`. */
+enum class AllocationPhase : std::uint8_t
+{
+	Other,		// anything else, e.g. printing an error or submitting a job
+	Tokenize,	// splitting the line into tokens
+	Parse,		// splitting tokens into pipelines
+	Dispatch,	// running pipelines, finding commands and calling them
+	Command,	// body of a command, output written by it is `PipelineIO`
+	PipelineIO,	// pipeline buffers, redirections and output written to them
+};
+
+/** @brief Number and bytes of allocations made while running a command line, by phase. */
+struct AllocationStats
+{
+	static constexpr std::size_t PHASES = std::size_t(AllocationPhase::PipelineIO) + 1;
+
+	struct Counter
+	{
+		std::uint64_t count = 0;
+		std::uint64_t bytes = 0;
+	};
+	std::array<Counter, PHASES> phases{};
+
+	Counter& operator[](AllocationPhase phase) { return phases[std::size_t(phase)]; }
+	const Counter& operator[](AllocationPhase phase) const { return phases[std::size_t(phase)]; }
+	Counter total() const
+	{
+		Counter sum;
+		for (const Counter& phase : phases)
+		{
+			sum.count += phase.count;
+			sum.bytes += phase.bytes;
+		}
+		return sum;
+	}
+};
+
+NAMESPACE_BEGIN(detail)
+
+/** @brief Where allocations of the calling thread are counted, nullptr while no line is running. */
+inline thread_local AllocationStats* allocation_stats = nullptr;
+inline thread_local AllocationPhase allocation_phase = AllocationPhase::Other;
+
+/** @brief Count allocations of the calling thread in `phase` until the end of the scope. */
+class AllocationPhaseScope
+{
+public:
+	explicit AllocationPhaseScope(AllocationPhase phase) noexcept
+		: previous(allocation_phase) { allocation_phase = phase; }
+	AllocationPhaseScope(const AllocationPhaseScope&) = delete;
+	~AllocationPhaseScope() { allocation_phase = previous; }
+private:
+	AllocationPhase previous;
+};
+
+NAMESPACE_END(detail)
+
+/**
+ * @brief Count an allocation of `bytes` made by the calling thread in the current phase.
+ * @details The library doesn't replace any allocation function, a program that wants allocations
+ *          counted calls this from its own hook, e.g. a replaced global `operator new` in a test
+ *          or a benchmark. Allocations made while no line is running are ignored.
+ * @note  Must not allocate itself.
+**/
+inline void record_allocation(std::size_t bytes) noexcept
+{
+	if (AllocationStats* stats = detail::allocation_stats)
+	{
+		auto& counter = (*stats)[detail::allocation_phase];
+		counter.count++;
+		counter.bytes += bytes;
+	}
+}
+
+CLIPP_END
+
+#endif //! __CLIPP_ALLOCATIONS_HEADER__
@@ -3,14 +3,23 @@
 
 #include <sstream>
 #include <vector>
-#include <set>
+#include <array>
+#include <span>
+#include <memory>
+#include <iterator>
+#include <optional>
+#include <unordered_map>
 
 #include "defines.hpp"
 #include "Exceptions.hpp"
+#include "detail.hpp"
 #include "detail/Types.hpp"
+#include "detail/InplaceFunction.hpp"
 
 CLIPP_BEGIN
 
+namespace detail { class MappedFile; }
+
 template<typename T>
 concept HasNoCVRef = std::is_same_v<T, std::remove_cvref_t<T>>;
 
@@ -27,18 +36,58 @@ public:
 	};
 public:
 	OptionBase(Type opt_type, StringView desc = "")
-		: is_required{false}, desc{desc}
+		: is_required{false}, is_given{false}, desc{desc}, opt_type{opt_type}
 	{}
 
 	virtual ~OptionBase() = default;
 
+	/** @brief Copy of this option, with its settings and its current value. */
+	virtual OptionBase* clone() const = 0;
+
 	virtual constexpr const std::type_info& storedTypeInfo() const = 0;
 	virtual constexpr const String& storedTypeName() const = 0;
 
 	virtual const String& name() const = 0;
 	virtual bool checkName(StringView name) const = 0;
-	
-	bool required() { return is_required; }
+	/** @brief Short name used as `-c`, `0` if there's none. */
+	virtual char shortName() const { return '\0'; }
+	/** @brief Names used as `--name`, positional arguments have none. */
+	virtual std::span<const String> longNames() const { return {}; }
+
+	/**
+	 * @brief Set the value from an argument at once, flags ignore `text`.
+	 * @throws if `text` can't be converted to the type of the value
+	**/
+	virtual void assign(StringView text) = 0;
+	/** @brief Number of values an occurrence of the option takes, see `MultiOption`. */
+	std::size_t arity() const { return value_count; }
+	/** @brief Return if the last `ArgParser::parse` has set this option. */
+	bool given() const { return is_given; }
+	/** @brief Restore the default value, as if no parse had given this option. */
+	virtual void reset() { is_given = is_pending = false; }
+	/**
+	 * @brief Convert the argument given to the last `ArgParser::parse`, if it isn't yet.
+	 * @throws `CLICommandParseError` if it's not a valid value, until another parse
+	**/
+	void resolve() const
+	{
+		if (!is_pending)
+			return;
+		try
+		{
+			// options with a pending argument are created by a parser, they are never const objects
+			const_cast<OptionBase*>(this)->convert();
+		}
+		catch (const std::exception& e)
+		{
+			if (opt_type == Type::Positional)
+				throw CLICommandParseError("invalid value for <{}>: {}", name(), e.what());
+			throw CLICommandParseError("invalid value for --{}: {}", name(), e.what());
+		}
+		is_pending = false;
+	}
+
+	bool required() const { return is_required; }
 	OptionBase* setRequired(bool is_required) { this->is_required = is_required; return this; }
 
 	const String& description() const { return desc; }
@@ -66,6 +115,11 @@ public:
 	}
 
 protected:
+	/** @brief Convert the arguments given to the last parse. */
+	virtual void convert() { assign(text); }
+	/** @brief Keep an argument given to an option collecting values, `convert` converts them. */
+	virtual void collect(StringView) {}
+
 	static StringView validateLongName(StringView long_name)
 	{
 		auto space_pos = long_name.find_first_not_of(' ');
@@ -81,9 +135,18 @@ protected:
 
 private:
 	bool is_required;
+	bool is_given;
+	/** @brief Argument not converted yet, it refers to the arguments given to the parser. */
+	mutable bool is_pending = false;
+	StringView text;
 	String desc;
 
 	Type opt_type;
+protected:
+	std::size_t value_count = 1;
+	bool collects = false;	// arguments are given to `collect`, rather than kept in `text`
+
+	friend class ArgParser;
 };
 
 using OptionType = OptionBase::Type;
@@ -96,7 +159,7 @@ public:
 
 public:
 	Option(StringView name, char short_name = '\0', const T& default_value = T{}, StringView desc = "")
-		: OptionBase{OptionType::Option, desc}, value{default_value}
+		: OptionBase{OptionType::Option, desc}, value{default_value}, default_value{default_value}
 		, short_name{short_name}
 	{
 		auto processed_name = this->validateLongName(name);
@@ -105,8 +168,10 @@ public:
 
 	virtual ~Option() = default;
 
-	const value_type& get() const { return value; }
-	value_type& get() { return value; }
+	virtual Option* clone() const override { return new Option(*this); }
+
+	const value_type& get() const { this->resolve(); return value; }
+	value_type& get() { this->resolve(); return value; }
 
 	Option* setRequired(bool is_required)
 	{
@@ -131,8 +196,15 @@ public:
 		return false;
 	}
 
-	char shortName() const { return short_name; }
-	const std::vector<String>& longNames() const { return long_names; }
+	virtual char shortName() const override { return short_name; }
+	virtual std::span<const String> longNames() const override { return long_names; }
+
+	virtual void assign(StringView text) override { detail::assign_text(value, text); }
+	virtual void reset() override
+	{
+		this->OptionBase::reset();
+		value = default_value;
+	}
 
 	Option* addLongName(StringView long_name)
 	{
@@ -144,6 +216,7 @@ public:
 
 private:
 	T value;
+	T default_value;
 
 	char short_name;
 	std::vector<String> long_names;
@@ -162,14 +235,16 @@ public:
 
 public:
 	Option(StringView long_name, char short_name = '\0', bool default_value = false, StringView desc = "")
-		: OptionBase{OptionType::Flag, desc}, value{default_value}
+		: OptionBase{OptionType::Flag, desc}, value{default_value}, default_value{default_value}
 		, short_name{short_name}
 	{ long_names.emplace_back(this->validateLongName(long_name)); }
 
 	virtual ~Option() = default;
 
-	const value_type& get() const { return value; }
-	value_type& get() { return value; }
+	virtual Option* clone() const override { return new Option(*this); }
+
+	const value_type& get() const { this->resolve(); return value; }
+	value_type& get() { this->resolve(); return value; }
 
 	Option* setRequired(bool is_required)
 	{
@@ -195,8 +270,16 @@ public:
 		return false;
 	}
 
-	char shortName() const { return short_name; }
-	const std::vector<String>& longNames() const { return long_names; }
+	virtual char shortName() const override { return short_name; }
+	virtual std::span<const String> longNames() const override { return long_names; }
+
+	/** @brief A flag given is `true`, or `false` if it stores false. */
+	virtual void assign(StringView) override { value = !store_false; }
+	virtual void reset() override
+	{
+		this->OptionBase::reset();
+		value = default_value;
+	}
 
 	Option* addLongName(StringView long_name)
 	{
@@ -209,7 +292,8 @@ public:
 
 private:
 	value_type value;
-	bool store_false;
+	value_type default_value;
+	bool store_false = false;
 
 	char short_name;
 	std::vector<String> long_names;
@@ -226,10 +310,12 @@ public:
 	using value_type = T;
 public:
 	PositionalArgument(StringView name, const T& default_value = T{}, StringView desc = "")
-		: OptionBase{OptionType::Positional, desc}, value{default_value}
+		: OptionBase{OptionType::Positional, desc}, value{default_value}, default_value{default_value}
 		, arg_name{OptionBase::validateLongName(name)}
 	{}
-	
+
+	virtual PositionalArgument* clone() const override { return new PositionalArgument(*this); }
+
 	virtual constexpr const std::type_info& storedTypeInfo() const override { return typeid(T); }
 	virtual constexpr const String& storedTypeName() const override { return detail::NameOfType<T>; }
 
@@ -247,46 +333,359 @@ public:
 		return this;
 	}
 
-	const value_type& get() const { return value; }
-	value_type& get() { return value; }
+	const value_type& get() const { this->resolve(); return value; }
+	value_type& get() { this->resolve(); return value; }
+
+	virtual void assign(StringView text) override { detail::assign_text(value, text); }
+	virtual void reset() override
+	{
+		this->OptionBase::reset();
+		value = default_value;
+	}
 
 private:
 	T value;
+	T default_value;
 	String arg_name;
 
 public:
 	bool operator==(StringView name) const { return this->checkName(name); }
 };
 
+/**
+ * @brief Option collecting its values into contiguous storage: it may repeat (`-I a -I b`), an
+ *        occurrence may take several values (`--range 1 10`, see `arity`) and each value may be
+ *        a delimited list (`--ids 1,2,3`, see `setDelimiter`).
+ * @details The arguments of every occurrence are kept by the parser, the first `get` converts
+ *          them all at once: storage grows once, runs of numbers go through `std::from_chars`
+ *          in a single pass (see `detail::append_values`). Storage is reused by the next parse,
+ *          with room for `arity` values reserved up front.
+**/
+template<HasNoCVRef T>
+class MultiOption : public OptionBase
+{
+public:
+	using value_type = T;
+
+public:
+	MultiOption(StringView name, char short_name = '\0', std::size_t arity = 1, StringView desc = "")
+		: OptionBase{OptionType::Option, desc}, short_name{short_name}
+	{
+		if (arity == 0)
+			throw CLIException("an option takes at least one value");
+		long_names.emplace_back(this->validateLongName(name));
+		this->value_count = arity;
+		this->collects = true;
+		texts.reserve(arity);
+		values.reserve(arity);
+	}
+
+	virtual ~MultiOption() = default;
+
+	virtual MultiOption* clone() const override { return new MultiOption(*this); }
+
+	std::span<const value_type> get() const { this->resolve(); return values; }
+	std::span<value_type> get() { this->resolve(); return values; }
+
+	MultiOption* setRequired(bool is_required)
+	{
+		this->OptionBase::setRequired(is_required);
+		return this;
+	}
+	MultiOption* setDescription(StringView desc)
+	{
+		this->OptionBase::setDescription(desc);
+		return this;
+	}
+	/** @brief Split every value at `delimiter`, `'\0'` (the default) doesn't split them. */
+	MultiOption* setDelimiter(CharType delimiter) { this->delimiter = delimiter; return this; }
+	/** @brief Reserve room for `count` values, e.g. the number of occurrences expected. */
+	MultiOption* reserve(std::size_t count)
+	{
+		texts.reserve(count);
+		values.reserve(count);
+		return this;
+	}
+
+	virtual constexpr const std::type_info& storedTypeInfo() const override { return typeid(std::vector<T>); }
+	virtual constexpr const String& storedTypeName() const override { return detail::NameOfType<std::vector<T>>; }
+
+	virtual const String& name() const override { return long_names.front(); }
+	virtual bool checkName(StringView name) const override
+	{
+		for (auto& lname : long_names)
+			if (lname == name)
+				return true;
+		return false;
+	}
+
+	virtual char shortName() const override { return short_name; }
+	virtual std::span<const String> longNames() const override { return long_names; }
+
+	/** @brief Append the values of `text`. */
+	virtual void assign(StringView text) override { detail::append_values(values, text, delimiter); }
+	/** @brief Drop every value, storage is kept. */
+	virtual void reset() override
+	{
+		this->OptionBase::reset();
+		values.clear();
+		texts.clear();
+	}
+
+	MultiOption* addLongName(StringView long_name)
+	{
+		long_names.emplace_back(this->validateLongName(long_name));
+		return this;
+	}
+
+protected:
+	virtual void convert() override
+	{
+		values.clear();
+		values.reserve(texts.size());
+		for (StringView text : texts)
+			assign(text);
+	}
+	virtual void collect(StringView text) override
+	{
+		texts.push_back(text);
+	}
 
+private:
+	std::vector<value_type> values;
+	std::vector<StringView> texts;	// arguments given to the last parse, converted by `get`
+	CharType delimiter = '\0';
+
+	char short_name;
+	std::vector<String> long_names;
+};
+
+/**
+ * @brief Parser of command line arguments, e.g. those `main` gets.
+ * @details Arguments are parsed in a single pass, looked at in place without being copied:
+ *          `--name value`, `--name=value`, `-n value`, `-nvalue`, bundled flags (`-abc`, where
+ *          the last one may take a value), and `--` after which every argument is positional.
+ *          Positional arguments are assigned in the order they were added.
+ *
+ *          Values are converted lazily: parsing only keeps the argument of each option given,
+ *          it's converted by the first `get` of the option, which throws if it's invalid. So
+ *          the arguments must outlive the parsed values, unless conversion is eager (`setEager`).
+ *
+ *          Huge argument lists are read without being copied: `@file` arguments can be replaced
+ *          with the tokens of a memory mapped file (`setResponseFiles`), and positional
+ *          arguments past those added can be read as a lazy range (`setExtraPositionals`).
+ *
+ *          Subcommands (`addSubcommand`) are parsers of their own, making a tree like the one of
+ *          `git remote add`. Each of them has its own lookup tables, so parsing only ever looks
+ *          at the parsers of the subcommands given, whatever the size of the tree.
+ * @note  Short names are looked up in a table of 256 entries, long names in a hash table. Both
+ *        are built by the first parse after an option is added, so names an option gets
+ *        afterwards (`Option::addLongName`) aren't known until another option is added.
+**/
 class ArgParser
 {
 public:
+	/** @brief Input range over the extra positional arguments of a parse, see `extraPositionals`. */
+	class ExtraPositionals
+	{
+	public:
+		class iterator
+		{
+		public:
+			using value_type = StringView;
+			using difference_type = std::ptrdiff_t;
+
+			iterator() = default;
+			StringView operator*() const { return current; }
+			iterator& operator++()
+			{
+				if (!parser->nextExtra(current))
+					parser = nullptr;
+				return *this;
+			}
+			void operator++(int) { ++*this; }
+			bool operator==(std::default_sentinel_t) const { return parser == nullptr; }
+		private:
+			explicit iterator(ArgParser* parser) : parser(parser) { ++*this; }
+
+			ArgParser* parser = nullptr;
+			StringView current;
+
+			friend class ExtraPositionals;
+		};
+
+		iterator begin() const { return iterator(parser); }
+		std::default_sentinel_t end() const { return {}; }
+	private:
+		explicit ExtraPositionals(ArgParser* parser) : parser(parser) {}
+
+		ArgParser* parser;
+
+		friend class ArgParser;
+	};
+public:
+	ArgParser();
+	ArgParser(const ArgParser&) = delete;
+	ArgParser& operator=(const ArgParser&) = delete;
+	~ArgParser();
+
+	/**
+	 * @brief Parse arguments, the first of them is the program name. Options and positional
+	 *        arguments not given get their default, whether or not the last parse was read.
+	 * @throws `CLICommandParseError` on an unknown option, a missing or invalid value, an
+	 *         unexpected positional argument, or if a required one isn't given
+	 * @throws `CLIException` if several options have the same name
+	**/
 	void parse(int argc, const char** argv);
 	void parse(const std::vector<String>& args);
-
+	void parse(std::span<const StringView> args);
+
+	/**
+	 * @brief Convert every value given to the last parse now.
+	 * @throws `CLICommandParseError` for the first value that's invalid
+	**/
+	void validate() const;
+	/** @brief Restore the default value of every option and positional argument, subcommands included. */
+	void reset();
+	/**
+	 * @brief Copy of this parser, with copies of its options, positional arguments and
+	 *        subcommands. Each copy parses on its own, e.g. one per thread, `copyOf` maps an
+	 *        option of this parser to that of the copy.
+	**/
+	std::unique_ptr<ArgParser> clone() const;
+	/** @brief Option of this parser copied from `opt`, one of the parser `clone` was called on, or nullptr. */
+	template<typename Opt>
+	Opt* copyOf(const Opt* opt) const { return static_cast<Opt*>(findCopy(opt)); }
+	/** @brief Make `parse` convert every value given before returning, i.e. call `validate`. */
+	void setEager(bool eager = true) { this->eager = eager; }
+	/**
+	 * @brief Make `parse` replace every argument `@path` with the tokens of the file `path`, split
+	 *        like a command line (see `detail::split_token`). `@path` in a file isn't expanded.
+	 * @details Files are mapped as private copies and tokenized in place, tokens stay valid until
+	 *          the next parse. A file that can't be read, or has an unbalanced quote, is a
+	 *          `CLICommandParseError` thrown when it's reached.
+	**/
+	void setResponseFiles(bool enable = true) { response_files = enable; }
+	/**
+	 * @brief Accept any number of positional arguments after those added. Parsing stops at the
+	 *        first of them, so its cost doesn't depend on how many there are. It and every
+	 *        argument after it, options included, are read through `extraPositionals`.
+	**/
+	void setExtraPositionals(bool enable = true) { extra_positionals = enable; }
+	/**
+	 * @brief Lazy range over the extra positional arguments of the last parse, response files
+	 *        are read as it's iterated. Arguments are read once: iterating again continues where
+	 *        the last iteration stopped.
+	 * @throws `CLICommandParseError` while iterating, for a response file as `setResponseFiles`
+	**/
+	ExtraPositionals extraPositionals() { return ExtraPositionals(this); }
+
+	/**
+	 * @brief Add an option taking a value, `bool` options are flags.
+	 * @note  The parser owns the option, the pointer returned stays valid as long as it.
+	**/
 	template<HasNoCVRef T>
-	Option<T>* addOption(StringView name, char short_name, T& def, StringView desc = String())
+	Option<T>* addOption(StringView name, char short_name = '\0', const T& def = T{}, StringView desc = String())
 	{
-		Option<T>* opt = new Option<bool>{name, short_name, false, desc};
-		options.insert(opt);
+		auto* opt = new Option<T>{name, short_name, def, desc};
+		options.push_back(opt);
+		index_built = false;
 		return opt;
 	}
 
 	Option<bool>* addFlag(StringView name, char short_name, StringView desc = String())
 	{
-		Option<bool>* opt = new Option<bool>{name, short_name, false, desc};
-		options.insert(opt);
-		
+		return this->addOption<bool>(name, short_name, false, desc);
+	}
+
+	/** @brief Add an option collecting values, `arity` of them for each occurrence, see `MultiOption`. */
+	template<HasNoCVRef T>
+	MultiOption<T>* addMultiOption(StringView name, char short_name = '\0', std::size_t arity = 1, StringView desc = String())
+	{
+		auto* opt = new MultiOption<T>{name, short_name, arity, desc};
+		options.push_back(opt);
+		index_built = false;
 		return opt;
 	}
 
+	/** @brief Add a positional argument, they are assigned in the order they are added. */
+	template<HasNoCVRef T>
+	PositionalArgument<T>* addPositional(StringView name, const T& def = T{}, StringView desc = String())
+	{
+		auto* arg = new PositionalArgument<T>{name, def, desc};
+		positionals.push_back(arg);
+		return arg;
+	}
+
+	/**
+	 * @brief Add a subcommand, with options and positional arguments of its own. Once the
+	 *        positional arguments of this parser are given, the next one names a subcommand,
+	 *        whose parser parses every argument after it.
+	 * @details A subcommand selected by a parse is reset by it, like this parser. One that isn't
+	 *          keeps what its last parse set, see `selectedSubcommand`. Response files are
+	 *          expanded by the settings of the parser `parse` is called on.
+	 * @note  This parser owns the subcommand, the pointer returned stays valid as long as it.
+	**/
+	ArgParser* addSubcommand(StringView name, StringView desc = String());
+	/** @brief Subcommand named by the last parse, nullptr if none was. */
+	ArgParser* selectedSubcommand() const { return selected; }
+
+	/** @brief Options, positional arguments and subcommands, in the order they were added. */
+	std::span<OptionBase* const> optionList() const { return options; }
+	std::span<OptionBase* const> positionalList() const { return positionals; }
+	std::span<ArgParser* const> subcommandList() const { return subcommands; }
+
+	/** @brief Name of the program, i.e. the first argument of the last parse. */
+	const String& programName() const { return program; }
+	/** @brief Name of a subcommand, empty for a parser that isn't one. */
+	const String& commandName() const { return command_name; }
+	const String& description() const { return desc; }
+
 private:
+	using ArgSource = detail::InplaceFunction<StringView(std::size_t)>;
+
+	/** @brief Parse `count` arguments, `arg_at(i)` returns the i-th of them as a `StringView`. */
+	void parseArgs(std::size_t count, ArgSource arg_at);
+	/** @brief Parse the arguments `input` has left, the parser of a subcommand reads those of its parent. */
+	void parseFrom(ArgParser& input);
+	/** @brief Get the next argument, from a response file or `arg_at`, return false after the last one. */
+	bool nextArg(StringView& arg);
+	/** @brief Map the file of an argument `@path`, `nextArg` reads its tokens. */
+	void openResponseFile(StringView arg);
+	bool nextExtra(StringView& arg);
+	/** @brief Fill `short_index`, `long_index` and `subcommand_index`. */
+	void buildIndex();
+	OptionBase* findCopy(const OptionBase* opt) const;
+
 	String program;
+	String command_name;
+	String desc;
 
-	// std::map<StringView, OptionBase*> options;
-	std::set<OptionBase*> options;
+	// arguments of the last parse, kept for `extraPositionals`
+	ArgSource arg_at;
+	std::size_t arg_count = 0;
+	std::size_t next_arg = 0;
+	std::vector<std::unique_ptr<detail::MappedFile>> mapped_files;	// response files of the last parse
+	std::optional<detail::TokenScanner> file_tokens;	// tokens left in the response file being read
+	StringView file_arg;
+	StringView extra_first;	// extra positional argument read by the parse
+	bool extra_pending = false;
+	ArgParser* input = nullptr;	// parser whose arguments the last parse read
+
+	std::vector<OptionBase*> options;
 	std::vector<OptionBase*> positionals;
+
+	std::array<OptionBase*, 256> short_index{};
+	std::unordered_map<StringView, OptionBase*> long_index;	// keys refer to names of the options
+
+	std::vector<ArgParser*> subcommands;
+	std::unordered_map<StringView, ArgParser*> subcommand_index;	// keys refer to names of the subcommands
+	ArgParser* selected = nullptr;
+	const ArgParser* origin = nullptr;	// parser this one is a clone of
+	bool index_built = false;
+	bool eager = false;
+	bool response_files = false;
+	bool extra_positionals = false;
 };
 
 CLIPP_END
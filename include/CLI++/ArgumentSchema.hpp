@@ -0,0 +1,307 @@
+#ifndef __CLIPP_ARGUMENT_SCHEMA_HEADER__
+#define __CLIPP_ARGUMENT_SCHEMA_HEADER__
+
+#include "defines.hpp"
+#include "Exceptions.hpp"
+#include "detail/Types.hpp"
+
+#include <span>
+#include <array>
+#include <tuple>
+#include <cstdint>
+#include <utility>
+#include <algorithm>
+
+CLIPP_BEGIN
+
+/** @brief Option of an `ArgSchema`, setting `member` of the struct parsed. `bool` members are flags. */
+template<typename Struct, typename T>
+struct SchemaOption
+{
+	using struct_type = Struct;
+	using value_type = T;
+	static constexpr bool is_positional = false;
+	static constexpr bool is_flag = std::is_same_v<T, bool>;
+
+	T Struct::* member;
+	StringView long_name;
+	char short_name = '\0';
+	StringView desc;
+	bool is_required = false;
+
+	constexpr SchemaOption required(bool is_required = true) const
+	{
+		SchemaOption copy = *this;
+		copy.is_required = is_required;
+		return copy;
+	}
+};
+
+/** @brief Positional argument of an `ArgSchema`, they are assigned in the order of the schema. */
+template<typename Struct, typename T>
+struct SchemaPositional
+{
+	using struct_type = Struct;
+	using value_type = T;
+	static constexpr bool is_positional = true;
+	static constexpr bool is_flag = false;
+
+	T Struct::* member;
+	StringView name;
+	StringView desc;
+	bool is_required = false;
+
+	constexpr SchemaPositional required(bool is_required = true) const
+	{
+		SchemaPositional copy = *this;
+		copy.is_required = is_required;
+		return copy;
+	}
+};
+
+template<typename Struct, typename T>
+constexpr SchemaOption<Struct, T> option(T Struct::* member, StringView long_name, char short_name = '\0', StringView desc = "")
+{
+	return { member, long_name, short_name, desc };
+}
+
+template<typename Struct>
+constexpr SchemaOption<Struct, bool> flag(bool Struct::* member, StringView long_name, char short_name = '\0', StringView desc = "")
+{
+	return { member, long_name, short_name, desc };
+}
+
+template<typename Struct, typename T>
+constexpr SchemaPositional<Struct, T> positional(T Struct::* member, StringView name, StringView desc = "")
+{
+	return { member, name, desc };
+}
+
+/**
+ * @brief Arguments of a program described at compile time, parsed into a plain struct whose
+ *        members are given by the schema. A value is then read as a member, without any
+ *        virtual call, cast or heap allocated option.
+ * @details Parsing follows the rules of `ArgParser::parse`. Lookup tables of names are built by
+ *          the constructor, so a `constexpr` schema has them built at compile time, as well as
+ *          duplicate names reported as a compile error. Members not given keep the value
+ *          `Struct{}` has.
+ * @code
+ *   struct Args { bool verbose = false; int port = 8080; String config; };
+ *   constexpr ArgSchema schema{
+ *       flag(&Args::verbose, "verbose", 'v'),
+ *       option(&Args::port, "port", 'p'),
+ *       positional(&Args::config, "config").required(),
+ *   };
+ *   Args args = schema.parse(argc, argv);
+ * @endcode
+**/
+template<typename Struct, typename... Fields>
+class ArgSchema
+{
+public:
+	static constexpr std::size_t FIELDS = sizeof...(Fields);
+	static constexpr std::size_t POSITIONALS = (std::size_t(Fields::is_positional) + ... + 0);
+	static_assert(FIELDS < 255, "too many fields in a schema");
+	static_assert((std::is_same_v<typename Fields::struct_type, Struct> && ...), "fields of a schema must belong to the same struct");
+public:
+	constexpr ArgSchema(Fields... fields)
+		: fields(fields...)
+	{
+		short_index.fill(NONE);
+		std::size_t long_count = 0;
+		std::size_t positional_count = 0;
+		forEach([&](const auto& field, std::size_t i) {
+			using Field = std::remove_cvref_t<decltype(field)>;
+			if constexpr (Field::is_positional)
+				positional_index[positional_count++] = std::uint8_t(i);
+			else
+			{
+				long_index[long_count++] = LongName{ field.long_name, std::uint8_t(i) };
+				if (field.short_name != '\0')
+				{
+					auto& slot = short_index[static_cast<unsigned char>(field.short_name)];
+					if (slot != NONE)
+						throw CLIException("duplicate short option in a schema");
+					slot = std::uint8_t(i);
+				}
+			}
+		});
+		std::sort(long_index.begin(), long_index.end(), [](const LongName& a, const LongName& b) { return a.name < b.name; });
+		for (std::size_t i = 1; i < long_index.size(); i++)
+		{
+			if (long_index[i - 1].name == long_index[i].name)
+				throw CLIException("duplicate long option in a schema");
+		}
+	}
+
+	/**
+	 * @brief Parse arguments, the first of them is the program name.
+	 * @throws `CLICommandParseError` like `ArgParser::parse`
+	**/
+	Struct parse(int argc, const char** argv) const
+	{
+		return parseArgs(std::size_t(argc), [argv](std::size_t i) { return StringView(argv[i]); });
+	}
+	Struct parse(std::span<const StringView> args) const
+	{
+		return parseArgs(args.size(), [args](std::size_t i) { return args[i]; });
+	}
+
+	const std::tuple<Fields...>& fieldList() const { return fields; }
+private:
+	static constexpr std::uint8_t NONE = 0xFF;
+	static constexpr std::array<bool, FIELDS> FLAGS = { Fields::is_flag... };
+
+	struct LongName
+	{
+		StringView name;
+		std::uint8_t field;
+	};
+
+	/** @brief Call `f(field, index)` for every field. */
+	template<typename Func>
+	constexpr void forEach(Func&& f) const
+	{
+		[&]<std::size_t... I>(std::index_sequence<I...>) {
+			(f(std::get<I>(fields), I), ...);
+		}(std::index_sequence_for<Fields...>{});
+	}
+	/** @brief Call `f(field)` for the field at `index`, the switch over indices is left to the compiler. */
+	template<typename Func>
+	void visit(std::size_t index, Func&& f) const
+	{
+		[&]<std::size_t... I>(std::index_sequence<I...>) {
+			((index == I ? (f(std::get<I>(fields)), true) : false) || ...);
+		}(std::index_sequence_for<Fields...>{});
+	}
+
+	std::size_t findLong(StringView name) const
+	{
+		auto it = std::lower_bound(long_index.begin(), long_index.end(), name,
+			[](const LongName& entry, StringView name) { return entry.name < name; });
+		return (it != long_index.end() && it->name == name) ? it->field : NONE;
+	}
+
+	void set(Struct& out, std::size_t index, StringView given, StringView text) const
+	{
+		visit(index, [&](const auto& field) {
+			using Field = std::remove_cvref_t<decltype(field)>;
+			if constexpr (Field::is_flag)
+				out.*field.member = true;
+			else
+			{
+				try
+				{
+					detail::assign_text(out.*field.member, text);
+				}
+				catch (const std::exception& e)
+				{
+					throw CLICommandParseError("invalid value for {}: {}", given, e.what());
+				}
+			}
+		});
+	}
+
+	template<typename ArgAt>
+	Struct parseArgs(std::size_t count, ArgAt&& arg_at) const
+	{
+		Struct out{};
+		std::array<bool, FIELDS> given{};
+		auto assign = [&](std::size_t index, StringView name, StringView text) {
+			set(out, index, name, text);
+			given[index] = true;
+		};
+
+		std::size_t next_positional = 0;
+		bool options_ended = false;
+		for (std::size_t i = 1; i < count; i++)
+		{
+			StringView arg = arg_at(i);
+			if (options_ended || arg.size() < 2 || arg[0] != '-')
+			{
+				if (next_positional == POSITIONALS)
+					throw CLICommandParseError("unexpected argument \"{}\"", arg);
+				std::size_t index = positional_index[next_positional++];
+				StringView name;
+				visit(index, [&name](const auto& field) {
+					if constexpr (std::remove_cvref_t<decltype(field)>::is_positional)
+						name = field.name;
+				});
+				assign(index, name, arg);
+				continue;
+			}
+
+			if (arg[1] == '-')
+			{
+				if (arg.size() == 2)
+				{
+					options_ended = true;
+					continue;
+				}
+				StringView name = arg.substr(2);
+				auto equal = name.find('=');
+				std::size_t index = findLong(name.substr(0, equal));
+				if (index == NONE)
+					throw CLICommandParseError("unknown option \"--{}\"", name.substr(0, equal));
+				StringView option = arg.substr(0, equal == StringView::npos ? arg.size() : equal + 2);
+
+				if (FLAGS[index])
+				{
+					if (equal != StringView::npos)
+						throw CLICommandParseError("option {} doesn't take a value", option);
+					assign(index, option, StringView());
+				}
+				else if (equal != StringView::npos)
+					assign(index, option, name.substr(equal + 1));
+				else if (i + 1 < count)
+					assign(index, option, arg_at(++i));
+				else
+					throw CLICommandParseError("option {} requires a value", option);
+				continue;
+			}
+
+			for (std::size_t j = 1; j < arg.size(); j++)
+			{
+				std::size_t index = short_index[static_cast<unsigned char>(arg[j])];
+				const CharType short_given[] = { '-', arg[j] };
+				StringView option(short_given, 2);
+				if (index == NONE)
+					throw CLICommandParseError("unknown option \"{}\"", option);
+				if (FLAGS[index])
+				{
+					assign(index, option, StringView());
+					continue;
+				}
+				if (j + 1 < arg.size())
+					assign(index, option, arg.substr(j + 1));
+				else if (i + 1 < count)
+					assign(index, option, arg_at(++i));
+				else
+					throw CLICommandParseError("option {} requires a value", option);
+				break;
+			}
+		}
+
+		forEach([&given](const auto& field, std::size_t i) {
+			if (!field.is_required || given[i])
+				return;
+			if constexpr (std::remove_cvref_t<decltype(field)>::is_positional)
+				throw CLICommandParseError("missing required argument <{}>", field.name);
+			else
+				throw CLICommandParseError("missing required option --{}", field.long_name);
+		});
+		return out;
+	}
+
+	std::tuple<Fields...> fields;
+	std::array<std::uint8_t, 256> short_index{};
+	std::array<LongName, FIELDS - POSITIONALS> long_index{};
+	std::array<std::uint8_t, POSITIONALS> positional_index{};
+};
+
+template<typename Field, typename... Fields>
+ArgSchema(Field, Fields...) -> ArgSchema<typename Field::struct_type, Field, Fields...>;
+
+CLIPP_END
+
+#endif //! __CLIPP_ARGUMENT_SCHEMA_HEADER__
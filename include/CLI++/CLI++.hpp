@@ -2,16 +2,39 @@
 #define __CLIPP_INTERACTIVE_HEADER__
 
 #include "Exceptions.hpp"
+#include "LineSource.hpp"
+#include "History.hpp"
+#include "Suggestion.hpp"
+#include "Metrics.hpp"
+#include "Tracing.hpp"
+#include "OutputCache.hpp"
+#include "Allocations.hpp"
+#include "ArgumentParser.hpp"
 #include "detail.hpp"
+#include "detail/InplaceFunction.hpp"
+#include "detail/SlotPool.hpp"
 
 #include <map>
+#include <memory>
+#include <memory_resource>
+#include <cstdint>
+#include <mutex>
 #include <functional>
 #include <fmt/color.h>
 #include <sstream>
 
 CLIPP_BEGIN
 
-using ArgList = std::vector<StringView>;
+namespace detail {
+class ThreadPool;
+class ProcessGroup;
+}
+
+/**
+ * @brief Arguments of a command, the first one is its name. Arguments of command lines are allocated
+ *        from the memory of the line (see `CLI::lineResource`), they are only valid while it runs.
+**/
+using ArgList = std::pmr::vector<StringView>;
 using TokenSpliterFunction = std::vector<String> (*)(StringView, detail::ArgvError*);
 
 class CLI;
@@ -26,6 +49,7 @@ class CLICommand
 public:
 	CLICommand(const String& cmd, const String& desc = String())
 		: cmd(cmd), desc(desc), options() {}
+	CLICommand(CLICommand&&) = default;
 	virtual ~CLICommand() = default;
 
 	const String& name() const { return cmd; }
@@ -33,6 +57,15 @@ public:
 	String& name() { return cmd; }
 	String& description() { return desc; }
 
+	/** @brief Return if output of this command depends only on its arguments and its input. */
+	bool pure() const { return is_pure; }
+	/**
+	 * @brief Declare that output of this command depends only on its arguments and its input, so
+	 *        it can be cached (see `CLI::setOutputCache`). A pure command must not read stdin,
+	 *        and must write its output with `CLI::print`.
+	**/
+	void setPure(bool pure = true) { is_pure = pure; }
+
 	/**
 	 * @brief Try to match the text with this command (which is usually partially matched),
 	 *        this method also tries to match its options or sub commands.
@@ -76,6 +109,27 @@ public:
 	 * @param short_name short option name, if equals to `0`, this method does nothing
 	**/
 	void removeOption(char short_name);
+	/**
+	 * @brief Typed arguments of this command: options, positional arguments and subcommands of
+	 *        an `ArgParser` created by the first call. Once it exists, CLI parses and converts
+	 *        the arguments of every call with it before calling the command, which reads the
+	 *        values of its options instead of parsing `ArgList` again. An invalid argument fails
+	 *        the call without running the command. Completion and `usage` come from it too,
+	 *        options added with `addOption` or `addSubCommand` are ignored.
+	 * @details Every call parses with a copy of the parser of its own, reset to the defaults
+	 *          first, so calls running at once (`pmap`, `|>`, jobs) or nested in one another don't
+	 *          share values. Copies are reused by later calls, with the lookup tables their first
+	 *          parse built. The command reads its values with `CLI::argument`, they refer to the
+	 *          arguments of the call and are valid while it runs.
+	 * @code
+	 *   auto* count = cli.command("repeat")->arguments().addOption<int>("count", 'n', 1);
+	 *   // the handler of "repeat" reads cli.argument(count).get()
+	 * @endcode
+	**/
+	ArgParser& arguments();
+	/** @brief Parser of the arguments, nullptr if `arguments` was never called. */
+	const ArgParser* argumentParser() const { return schema ? &schema->parser : nullptr; }
+
 	/**
 	 * @brief Add a sub command to this command.
 	 * @note  Sub commands are only used in completion and to generate usage string, CLI won't check if input meet
@@ -110,12 +164,27 @@ protected:
 	std::vector<OptionType> options;
 	std::vector<OptionType> subcmds;
 private:
+	struct Schema
+	{
+		ArgParser parser;
+		std::mutex lock;	// guards `idle` and `version`
+		std::vector<std::unique_ptr<ArgParser>> idle;	// copies of `parser` no call is using
+		std::size_t version = 0;	// changed by `arguments`, older copies aren't reused
+	};
+	/** @brief Options and sub commands of `arguments`, completion and usage use them instead of their own. */
+	void schemaOptions(std::vector<OptionType>& opts, std::vector<OptionType>& subs) const;
+
 	String cmd;
 	String desc;
+	bool is_pure = false;
+	std::unique_ptr<Schema> schema;
 
-	static int pos;	//used to determine whether to complete command or its arguments
+	// used to determine whether to complete command or its arguments,
+	// completion always runs on the thread of the session being completed
+	static thread_local int pos;
 
 	friend char** command_completion(const char* text, int start, int end);
+	friend class CLI;
 public:
 	bool operator==(const CLICommand& other) const { return cmd == other.cmd; }
 	bool operator< (const CLICommand& other) const { return cmd <  other.cmd; }
@@ -137,6 +206,27 @@ public:
 	{ return std::invoke(fn, cli, args); }
 };
 
+/**
+ * @brief Command calling a type erased handler kept in the object itself, this is what
+ *        `CLI::insertCommand(name, f, desc)` creates. Objects live in a pool of their registry,
+ *        next to each other.
+**/
+class CLICommandFunction final : public CLICommand
+{
+public:
+	using Handler = detail::InplaceFunction<int(CLI&, const ArgList&)>;
+public:
+	template<CommandHandler Func>
+	CLICommandFunction(const String& cmd, Func&& f, const String& desc = String())
+		: CLICommand(cmd, desc), fn(std::forward<Func>(f)) {}
+	CLICommandFunction(CLICommandFunction&&) = default;
+private:
+	Handler fn;
+public:
+	virtual int operator()(CLI& cli, const ArgList& args) const override
+	{ return fn(cli, args); }
+};
+
 class Pipeline
 {
 public:
@@ -164,9 +254,38 @@ public:
 	virtual void open();
 	/** @brief Close the pipeline. */
 	virtual void close();
+	/** @brief Close the pipeline, drop all redirections and reset working input to stdin. */
+	void reset();
 
 	/** @brief Return if the pipeline is opened. */
 	bool opened() const { return is_opened; }
+	/** @brief Return if output is sent to a stream, rather than stdout. */
+	bool writable() const { return working.out != nullptr; }
+	/** @brief Number of characters written with `write` since the pipeline was created. */
+	std::uint64_t written() const { return written_count; }
+	/** @brief Position in the working input, `-1` if it isn't seekable (e.g. stdin). */
+	std::streamoff inputPosition() const;
+
+	/**
+	 * @brief Redirect input of the first command, takes effect on the next `open`.
+	 * @note  The caller need to ensure the life time of the stream object.
+	 * @param in stream to read from, `nullptr` means stdin
+	**/
+	void redirectInput(std_istream* in) { redirect.in = in; }
+	/**
+	 * @brief Redirect output of the last command, takes effect on the next `close`.
+	 * @note  The caller need to ensure the life time of the stream object.
+	 * @param out stream to write to, `nullptr` means stdout
+	**/
+	void redirectOutput(std_ostream* out) { redirect.out = out; }
+	/**
+	 * @brief Set streams that stand in for stdin and stdout, they are used whenever input
+	 *        or output is not redirected.
+	 * @note  The caller need to ensure the life time of these two stream objects.
+	 * @param in  stream used as stdin, `nullptr` means stdin
+	 * @param out stream used as stdout, `nullptr` means stdout
+	**/
+	void setTerminal(std_istream* in, std_ostream* out) { terminal.in = in; terminal.out = out; }
 
 	/**
 	 * @brief Swap working input stream object, see `CLI::runPipeline`'s implementation
@@ -180,6 +299,15 @@ public:
 	 * @note  Only when you need to reimplement this method, do you need to care about it
 	**/
 	virtual void swapWorkingOutput();
+
+	/**
+	 * @brief Run a chain of external programs as one stage, their stdin is the working input
+	 *        and their stdout is the working output. See `detail::run_process_chain` for detail.
+	 * @param chain argument vectors of each program, the programs are connected by OS pipes
+	 * @param group if not `nullptr`, programs run in their own process group registered here
+	 * @return Bitwise or of exit codes of all programs.
+	**/
+	virtual int runExternal(const std::vector<std::vector<String>>& chain, detail::ProcessGroup* group = nullptr);
 protected:
 	struct StreamBuffer
 	{
@@ -188,8 +316,13 @@ protected:
 
 		void clear()
 		{
+			// the buffer is emptied in place, so that its capacity is used again
 			if (auto ss = dynamic_cast<std_stringstream*>(stream))
-				ss->str(detail::StringConstant<>);
+			{
+				String contents = std::move(*ss->rdbuf()).str();
+				contents.clear();
+				ss->str(std::move(contents));
+			}
 			stream->clear();
 		}
 		void flush() { stream->flush(); }
@@ -204,7 +337,13 @@ private:
 		std_istream* in;
 	} working;
 
+	struct {
+		std_istream* in;
+		std_ostream* out;
+	} redirect, terminal;
+
 	bool is_opened;
+	std::uint64_t written_count;
 public:
 	template<typename T>
 	std_istream& operator>>(T& value) { return (*working.in) >> value; }
@@ -216,19 +355,197 @@ public:
 	 * @throws `CLIException` trying to write to a closed pipe
 	 * @return Reference to the currently working output stream.
 	**/
-	std_ostream& write(const String& str);
+	std_ostream& write(StringView str);
 };
 
+/**
+ * @brief Commands available to CLI sessions, predefined commands (`help`, `echo`, `exit` ...)
+ *        are always included.
+ * @details A registry is modified while being set up. Once it's shared between sessions (see
+ *          `CLI::shareCommands`) it's only accessed through a pointer to const, and can be used
+ *          from different threads safely. Commands keep no per-session state, they act on the
+ *          `CLI&` they are called with.
+**/
+class CommandRegistry
+{
+public:
+	using CommandMap = std::map<StringView, CLICommand*>;
+public:
+	CommandRegistry();
+	CommandRegistry(const CommandRegistry&) = delete;
+	CommandRegistry& operator=(const CommandRegistry&) = delete;
+	~CommandRegistry();
+
+	/**
+	 * @brief Insert a CLICommand or its derived class intance, and take its ownership.
+	 * @note  If a command with same name already exists, the old one will be deleted.
+	**/
+	void insert(CLICommand* command);
+	/**
+	 * @brief Create a command calling `f`, it's kept in the pool of this registry.
+	 * @note  If a command with same name already exists, the old one will be deleted.
+	**/
+	template<CommandHandler Func>
+	CLICommand* insert(const String& name, Func&& f, const String& desc = String())
+	{
+		void* slot = pool.allocate();
+		CLICommand* command;
+		try
+		{
+			command = ::new (slot) CLICommandFunction(name, std::forward<Func>(f), desc);
+		}
+		catch (...)
+		{
+			pool.deallocate(slot);
+			throw;
+		}
+		this->insert(command);
+		return command;
+	}
+	/**
+	 * @brief Remove a command and give up its ownership.
+	 * @note  A command created from a callable is moved out of the pool, so the pointer returned
+	 *        differs from the one `find` returned, and it can be deleted.
+	 * @return nullptr if command with specified name does not exists
+	**/
+	CLICommand* take(StringView name);
+
+	bool contains(StringView name) const { return commands.contains(name); }
+	/** @brief Find command by name, nullptr is returned if there's no such command. */
+	CLICommand* find(StringView name)
+	{
+		auto it = commands.find(name);
+		return it == commands.end() ? nullptr : it->second;
+	}
+	const CLICommand* find(StringView name) const
+	{
+		auto it = commands.find(name);
+		return it == commands.end() ? nullptr : it->second;
+	}
+
+	CommandMap::const_iterator begin() const { return commands.begin(); }
+	CommandMap::const_iterator end() const { return commands.end(); }
+private:
+	/** @brief Keep sub commands of `help` (used in completion) in sync with the registry. */
+	void updateHelp(const CLICommand* cmd, bool removed = false);
+	/** @brief Delete a command or give its slot back to the pool. */
+	void destroy(CLICommand* cmd);
+
+	detail::SlotPool<CLICommandFunction> pool;
+	CommandMap commands;	// values point to pooled or heap allocated commands
+};
+
+/**
+ * @brief An interactive session: its pipeline, return code, background jobs and line source.
+ * @note  Any number of sessions can exist in one process, each of them is driven by one thread
+ *        at a time. Sessions may share a `CommandRegistry`.
+**/
 class CLI
 {
 public:
+	/** @brief Create a session with a registry of its own, which can be modified through this session. */
 	CLI(const String& prompt = String("CLI> "), char completion_key = '\t', TokenSpliterFunction spliter = detail::split_token);
+	/** @brief Create a session running commands of a shared registry. */
+	CLI(std::shared_ptr<const CommandRegistry> commands, const String& prompt = String("CLI> "),
+		char completion_key = '\t', TokenSpliterFunction spliter = detail::split_token);
 	virtual ~CLI();
 
-	/**  @brief Start CLI main loop. */
+	/**
+	 * @brief Start CLI main loop, lines are read from the line source until it runs out.
+	 * @note  If no line source has been set, a `ReadlineSource` is created.
+	**/
 	virtual int exec();
+	/**
+	 * @brief Run a single command line, as `exec` does with every line it reads. Errors are
+	 *        printed, they are not thrown.
+	 * @return false if the line called `exit`, the exit code is available from `returnCode`.
+	**/
+	bool runLine(const String& line);
+	/** @brief Return code of the last command line. */
+	int returnCode() const { return last_return_code; }
 
 	void setPrompt(const String& prompt) { this->prompt = prompt; };
+	/**
+	 * @brief Replace the source `exec` reads lines from, e.g. a `QueueLineSource` to drive the
+	 *        CLI from code. Must not be called while `exec` is running.
+	**/
+	void setLineSource(std::unique_ptr<LineSource> source) { line_source = std::move(source); }
+	LineSource* lineSource() const { return line_source.get(); }
+	/**
+	 * @brief Keep lines run by `exec` in a persistent history, which may be shared with other
+	 *        sessions. Its latest entries are handed to the line source when `exec` starts, and
+	 *        readline's reverse search (`Ctrl-R`) searches it through its index.
+	**/
+	void setHistory(std::shared_ptr<History> history) { this->history_file = std::move(history); }
+	History* commandHistory() const { return history_file.get(); }
+	/**
+	 * @brief Suggest how the line being typed goes on, from lines run by `exec`. `ReadlineSource`
+	 *        shows suggestions as dimmed text after the cursor, `Right` or `Ctrl-F` accepts them.
+	 * @note  If a history is set, an empty model learns its latest entries when `exec` starts.
+	**/
+	void setSuggestions(std::shared_ptr<SuggestionModel> model) { suggestions = std::move(model); }
+	SuggestionModel* suggestionModel() const { return suggestions.get(); }
+	/**
+	 * @brief Text suggested after `line`: what the model predicts, or else the rest of the latest
+	 *        history entry starting with `line` (see `History::complete`). Empty if there's none,
+	 *        or no model is set.
+	**/
+	String suggestion(StringView line) const;
+	/**
+	 * @brief Metrics of commands run by this session, every session starts with its own. Pass
+	 *        the same object to several sessions to collect their metrics together, or nullptr
+	 *        to stop collecting.
+	**/
+	void setMetrics(std::shared_ptr<Metrics> metrics) { this->command_metrics = std::move(metrics); }
+	Metrics* metrics() const { return command_metrics.get(); }
+	/**
+	 * @brief Cache of outputs of pure commands run by this session, every session starts with
+	 *        its own. Successful invocations of a pure command are cached, an invocation with
+	 *        the same arguments and input writes the cached output rather than running it again.
+	 *        Pass nullptr to run pure commands every time.
+	 * @note  Input read from stdin is not part of the key, see `CLICommand::setPure`.
+	**/
+	void setOutputCache(std::shared_ptr<OutputCache> cache) { output_cache = std::move(cache); }
+	OutputCache* outputCache() const { return output_cache.get(); }
+	/**
+	 * @brief Allocations made by the thread running the last line of `runLine` (or `exec`), by phase.
+	 * @note  Allocations are only counted if the program calls `record_allocation` from a hook of its
+	 *        own, otherwise every counter is `0`. Those of other threads (fan-out branches, `pmap`
+	 *        workers, background jobs) aren't counted.
+	**/
+	const AllocationStats& lineAllocations() const { return line_allocations; }
+#if CLIPP_ENABLE_TRACING
+	/**
+	 * @brief Call `hook` before and after every step of the command lines run by this session,
+	 *        see `TraceEvent`. Hooks are called in the order they are added.
+	 * @note  Must not be called while a command line is running.
+	**/
+	void addTraceHook(TraceHook hook) { trace_hooks.push_back(std::move(hook)); }
+	void clearTraceHooks() { trace_hooks.clear(); }
+#endif
+	/**
+	 * @brief Set streams that stand in for stdin and stdout of this session, see `Pipeline::setTerminal`.
+	 *        `err` stands in for stderr, `printStderr` and errors of command lines go to it,
+	 *        nullptr means stderr.
+	 * @note  Must not be called while a command line is running.
+	**/
+	void setTerminal(Pipeline::std_istream* in, Pipeline::std_ostream* out, Pipeline::std_ostream* err = nullptr)
+	{
+		pipeline.setTerminal(in, out);
+		pipeline.reset();
+		error_stream = err;
+	}
+	/**
+	 * @brief Memory for temporary data of the command line running on the calling thread, which
+	 *        is released once the line has run. Tokens, pipelines and argument lists of the line
+	 *        are allocated from it, commands may use it as well.
+	 * @note  The resource is not thread safe, each thread running commands of a line (e.g. fan-out
+	 *        branches) has one of its own. Outside of a line, the default resource is returned.
+	**/
+	static std::pmr::memory_resource* lineResource()
+	{
+		return line_resource != nullptr ? line_resource : std::pmr::get_default_resource();
+	}
 
 	/**
 	 * @brief Create a command with specific name, description and action.
@@ -241,73 +558,92 @@ public:
 	template<CommandHandler Func>
 	void insertCommand(const String& name, Func&& f, const String& desc = String())
 	{
-		CLICommand* command = new CLICommandGeneric(name, std::forward<Func>(f), desc);
-		this->insertCommand(command);
+		editableCommands().insert(name, std::forward<Func>(f), desc);
 	}
 	/**
 	 * @brief Insert a CLICommand or its derived class intance.
 	 * @note  This method will take pointer's ownership, and delete it in destructor.
 	 *        If a command with same name already exists, the old one will be deleted.
 	 * @param command pointer to a CLICommand or its derived class intance, must be created with new operator
+	 * @throws `CLIException` if commands of this session are shared
 	**/
 	void insertCommand(CLICommand* command)
 	{
-		if (CLICommand* old = this->take(command->name()))
-			delete old;
-		commands.emplace(command->name(), command);
-		this->updateHelp(command);
+		editableCommands().insert(command);
 	}
 
 	/**
 	 * @brief Checks if CLI contains a command with specific name.
 	 * @param name command name to match
 	**/
-	bool contains(const String& name) const { return commands.contains(name); }
+	bool contains(const String& name) const { return registry->contains(name); }
 
 	/**
 	 * @brief Remove a CLICommand or its derived class intance pointer from CLI, and its ownership.
 	 * @note  This method will not delete the instance.
 	 * @param name command name to match
 	 * @return return nullptr if command with specified name does not exists
+	 * @throws `CLIException` if commands of this session are shared
 	**/
 	CLICommand* take(const String& name)
 	{
-		if (!commands.contains(name))
-			return nullptr;
-		CLICommand* ret = commands.at(name);
-		commands.erase(name);
-		return ret;
+		return editableCommands().take(name);
 	}
 	/**
 	 * @brief Find command by name
 	 * @param name command name to be matched
 	 * @return Pointer to the command found, if no matching command, nullptr is returned.
+	 * @throws `CLIException` if commands of this session are shared, use the const overload instead
 	**/
 	CLICommand* command(const String& name)
 	{
-		if (!commands.contains(name))
-			return nullptr;
-		return commands.at(name);
+		return editableCommands().find(name);
 	}
 	const CLICommand* command(const String& name) const
 	{
-		if (!commands.contains(name))
-			return nullptr;
-		return commands.at(name);
+		return registry->find(name);
+	}
+
+	/**
+	 * @brief Share commands of this session, e.g. to create more sessions with them. Commands can
+	 *        not be inserted, removed or modified through this session afterwards.
+	**/
+	std::shared_ptr<const CommandRegistry> shareCommands()
+	{
+		editable_registry = nullptr;
+		return registry;
+	}
+	const CommandRegistry& commands() const { return *registry; }
+	/**
+	 * @brief Typed argument of the command running on the calling thread, with the values its
+	 *        call was given (see `CLICommand::arguments`).
+	 * @param opt option or positional argument added to `arguments()` of the command
+	 * @throws `CLIException` if `opt` isn't one of the command running
+	**/
+	template<typename Opt>
+	Opt& argument(const Opt* opt) const
+	{
+		Opt* value = call_arguments != nullptr ? call_arguments->copyOf(opt) : nullptr;
+		if (value == nullptr)
+			throw CLIException(fmt::format("{} isn't an argument of the running command", opt->name()));
+		return *value;
 	}
 public: // pipeline supported i/o
 	/**
-	 * @brief Print message to stdout, if pipeline is opened (i.e used `|` in command line),
-	 *        formatted message is sent to pipeline.
+	 * @brief Print message to stdout, if pipeline is opened (i.e used `|` in command line)
+	 *        or output is redirected, formatted message is sent to pipeline.
 	 * @param fmt  format string
 	 * @param args format args
 	**/
 	template<typename ...Args>
 	void print(fmt::format_string<Args...>&& fmt, Args&& ... args) const
 	{
-		if (pipeline.opened())
+		if (Pipeline& active = activePipeline(); active.writable())
 		{
-			pipeline.write(fmt::format(fmt, std::forward<Args>(args)...));
+			// formatted on the stack unless it's long
+			fmt::basic_memory_buffer<CharType> buffer;
+			fmt::format_to(std::back_inserter(buffer), fmt, std::forward<Args>(args)...);
+			active.write(StringView(buffer.data(), buffer.size()));
 			return;
 		}
 		fmt::print(fmt, std::forward<Args>(args)...);
@@ -319,7 +655,7 @@ public: // pipeline supported i/o
 	**/
 	Pipeline::std_istream& get()
 	{
-		return pipeline.get();
+		return activePipeline().get();
 	}
 	/**
 	 * @brief Read data from input, if pipeline is opened (i.e used `|` in command line),
@@ -330,7 +666,7 @@ public: // pipeline supported i/o
 	template<typename ...Args>
 	Pipeline::std_istream& get(Args& ... args)
 	{
-		return (pipeline >> ... >> args);
+		return (activePipeline() >> ... >> args);
 		// return pipeline.get(std::forward<Args...>(args...));
 	}
 	/**
@@ -341,11 +677,12 @@ public: // pipeline supported i/o
 	**/
 	Pipeline::std_istream& getline(String& line)
 	{
-		return pipeline.getline(line);
+		return activePipeline().getline(line);
 	}
 
 	/**
-	 * @brief Print message to stderr.
+	 * @brief Print message to stderr, or to the error stream of the session if one is set
+	 *        (see `setTerminal`).
 	 * @note  This method won't pass content to pipeline in any case.
 	 * @param fmt  format string
 	 * @param args format args
@@ -353,6 +690,16 @@ public: // pipeline supported i/o
 	template<typename ...Args>
 	void printStderr(fmt::format_string<Args...>&& fmt, Args&& ... args) const
 	{
+		if (error_stream)
+		{
+			fmt::basic_memory_buffer<CharType> buffer;
+			fmt::format_to(std::back_inserter(buffer), fmt, std::forward<Args>(args)...);
+			// background jobs and pmap workers report errors as well
+			std::lock_guard lock(error_mutex);
+			error_stream->write(buffer.data(), buffer.size());
+			error_stream->flush();
+			return;
+		}
 		fmt::print(stderr, std::forward<fmt::format_string<Args...>>(fmt), std::forward<Args>(args)...);
 	}
 public:	// predefined commands
@@ -365,13 +712,80 @@ public:	// predefined commands
 	int help(const ArgList& args) const;
 	/** @brief Clear screen. */
 	int clearScreen() const;
+	/** @brief List background jobs and their states. */
+	int jobs(const ArgList& args) const;
+	/**
+	 * @brief Wait for specified background jobs (all of them if none is specified), then print
+	 *        their captured output and remove them.
+	 * @return Return code of the last job waited for, `127` if a job does not exist.
+	**/
+	int wait(const ArgList& args);
+	/**
+	 * @brief Stop specified background jobs. External programs they run are sent `SIGTERM`,
+	 *        commands should check `stopRequested` to stop early.
+	**/
+	int kill(const ArgList& args);
+
+	/**
+	 * @brief Split input into lines and run a command on each of them in parallel.
+	 * @details Usage: `pmap [-j N] [-n LINES] [-k] <command> [args...]`. Each group of `LINES` lines
+	 *          (1 by default) becomes the input of one invocation of `command`, invocations are
+	 *          spread over `N` worker threads (number of hardware threads by default). Workers are
+	 *          the calling thread and those of a pool the session keeps, which caps `N`. Outputs are
+	 *          written as soon as an invocation finishes, or in input order if `-k` is given.
+	 * @return Bitwise or of return codes of all invocations, `2` if arguments are invalid.
+	**/
+	int pmap(const ArgList& args);
+	/**
+	 * @brief Print entries of the persistent history, oldest first.
+	 * @details Usage: `history [-n COUNT] [PATTERN]`, prints the latest `COUNT` (20 by default)
+	 *          entries containing `PATTERN`.
+	**/
+	int history(const ArgList& args) const;
+	/**
+	 * @brief Print metrics of commands.
+	 * @details Usage: `stats [-r] [-p FILE] [COMMAND...]`, prints metrics of the given commands
+	 *          (all of them by default). `-p` exports all metrics to `FILE` in Prometheus text
+	 *          format instead, `-r` resets them afterwards.
+	**/
+	int stats(const ArgList& args);
+	/**
+	 * @brief Print statistics of the output cache, or drop outputs from it.
+	 * @details Usage: `cache [-c] [COMMAND...]`, `-c` drops outputs of the given commands (all of
+	 *          them by default).
+	**/
+	int cache(const ArgList& args);
+
+	/**
+	 * @brief Return if the command running on the calling thread belongs to a background job
+	 *        that has been asked to stop through `kill`. Long running commands should check this.
+	**/
+	bool stopRequested() const;
 protected:
-	using TokenList = std::vector<String>;
+	/** @brief Tokens of a line, they refer to a copy of the line allocated along with them. */
+	using TokenList = std::pmr::vector<StringView>;
 	struct PipelineRange
 	{
 		TokenList::const_iterator start;
 		TokenList::const_iterator end;
+		/** @brief File name after `<`, `nullptr` if input of the first command is not redirected. */
+		const TokenList::value_type* input = nullptr;
+		/** @brief File name after `>` or `>>`, `nullptr` if output of the last command is not redirected. */
+		const TokenList::value_type* output = nullptr;
+		/** @brief Whether output is redirected with `>>`. */
+		bool append = false;
+		/**
+		 * @brief Command lists inside `|> ( ... , ... )`, each of them reads the output of commands
+		 *        in front of `|>`. Empty if the pipeline doesn't fan out.
+		**/
+		std::pmr::vector<std::pmr::vector<PipelineRange>> branches;
+		/** @brief Prefix `time` or `profile` in front of the pipeline, `start` is after it. */
+		enum class Timing { None, Time, Profile } timing = Timing::None;
+		/** @brief Number of runs given to `profile -n`. */
+		std::size_t runs = 10;
 	};
+	/** @brief Pipelines of a command list, allocated from the same resource as its tokens. */
+	using PipelineList = std::pmr::vector<PipelineRange>;
 	/**
 	 * @brief Parse tokens, split them into sub ranges, each range represents a complete pipeline.
 	 * @note Any syntax error should be checked and handled in this method.
@@ -379,42 +793,174 @@ protected:
 	 * @param tokens tokens splited by `TokenSpliterFunction`
 	 * @return Sub ranges of token list, each range represents a complete pipeline. Ranges are seperated
 	 *         by operator `&&` or `||`, but not `|`. `PipelineRange::end` member is an iterator that
-	 *         points to the operator, except the last range.
+	 *         points to the operator, except the last range. Redirection operators and their file
+	 *         names stay inside the range, they are recorded in `PipelineRange::input` and `output`.
+	 *         So does a fan-out group, which is parsed into `PipelineRange::branches`. A `time` or
+	 *         `profile` prefix is left out of the range and recorded in `PipelineRange::timing`.
 	**/
-	virtual std::vector<PipelineRange> parse(const TokenList& tokens);
+	virtual PipelineList parse(const TokenList& tokens);
 	/**
 	 * @brief Execute pipelines one by one, the short circuit effect of operator `&&` or `||` will work.
 	 * @param cmds sub ranges returned by `CLI::parse`
 	 * @return The overall return code of all pipelines.
 	**/
-	virtual int execute(const std::vector<PipelineRange>& cmds);
+	virtual int execute(const PipelineList& cmds);
 	/**
 	 * @brief Execute pipeline.
 	 * @param pipe a `PipelineRange` parsed by `CLI::parse`
 	 * @return The overall return code of this pipelines
 	**/
 	virtual int runPipeline(const PipelineRange& _pipe);
+	/**
+	 * @brief Run a pipeline prefixed by `time` or `profile` and print its timings to stderr.
+	 * @details `time` runs it once and reports wall time, user and system CPU time, growth of
+	 *          peak RSS, with wall and CPU time of each stage. `profile` runs it `PipelineRange::runs`
+	 *          times with its output discarded, and reports percentiles of these timings.
+	 *          CPU time is the time of the whole process and its child processes, anything
+	 *          else running meanwhile (e.g. other sessions) is included.
+	 * @return Return code of the last run.
+	**/
+	virtual int timePipeline(const PipelineRange& pipe);
+
+	/**
+	 * @brief Call a command with `args`, its input and output are the working ones of `pipeline`.
+	 *        Metrics of the command are recorded if they are collected, output of a pure command
+	 *        is taken from the cache if it's there.
+	**/
+	int invoke(const CLICommand& command, const ArgList& args, Pipeline& pipeline);
+
+	/**
+	 * @brief Pipeline used by commands running on the calling thread, it's `CLI::pipeline`
+	 *        unless the thread is running a background job.
+	**/
+	Pipeline& activePipeline() const;
 
 	int last_return_code;
 	mutable Pipeline pipeline;
+	Pipeline::std_ostream* error_stream;
+	mutable std::mutex error_mutex;		// guards writes to `error_stream`
 private:
-	using CLICommandMap = std::map<StringView, CLICommand*>;
+	struct Job;
+	/** @brief State of a thread that is executing commands on behalf of this CLI. */
+	struct ExecContext
+	{
+		const CLI* owner;
+		Pipeline* pipeline;
+		Job* job;
+	};
+	static thread_local ExecContext* exec_context;
+	/** @brief Memory of the line running on the calling thread, see `lineResource`. */
+	static thread_local std::pmr::memory_resource* line_resource;
+	/** @brief Timings of a stage run by a pipeline being timed. */
+	struct StageTiming
+	{
+		String name;
+		std::uint64_t wall_ns;
+		std::uint64_t cpu_ns;
+		int return_code;
+	};
+	/** @brief Where `runPipeline` records timings of its stages, nullptr unless it's being timed. */
+	static thread_local std::vector<StageTiming>* stage_timings;
+	/** @brief Arguments parsed for the command running on the calling thread, see `argument`. */
+	static thread_local ArgParser* call_arguments;
 
-	static CLI* cli_instance;
-	static CLI* instance() { return cli_instance; }
+	/**
+	 * @brief Parse a command list starting from `it`. When `nested`, the list is a branch of a
+	 *        fan-out group and `it` is left on the `,` or `)` that ends it. Pipelines are
+	 *        allocated from `resource`.
+	**/
+	PipelineList parseList(TokenList::const_iterator& it, TokenList::const_iterator end, bool nested,
+		std::pmr::memory_resource* resource);
+	/**
+	 * @brief Run branches of a fan-out group in parallel, all of them read the unread contents of
+	 *        `active` without copying. Their outputs are written to `active` in order.
+	**/
+	int runBranches(const std::pmr::vector<PipelineList>& branches, Pipeline& active);
+	/** @brief Call a command for `invoke`, output of a pure command is taken from the cache or added to it. */
+	int callCached(const CLICommand& command, const ArgList& args, Pipeline& pipeline);
+
+	/** @brief Parse `command_line` (which ends with `&`) and run it as a background job. */
+	void submitJob(const String& command_line);
+	void runJob(Job& job);
+	/** @brief Print a line for every background job finished since the last call. */
+	void notifyJobs();
+
+#if CLIPP_ENABLE_TRACING
+	/** @brief Calls trace hooks when a step begins and when it ends, see `TraceEvent`. */
+	class TraceSpan;
+	/** @brief Step of a command line the calling thread is at, numbers events of nested steps. */
+	struct TraceCursor
+	{
+		std::size_t pipeline = 0;
+		std::size_t stage = 0;
+	};
+	static thread_local TraceCursor trace_cursor;
+	std::vector<TraceHook> trace_hooks;
+#endif
+
+	/** @brief Session whose `exec` is running on the calling thread, readline completes its commands. */
+	static thread_local CLI* current_session;
+	/** @brief State of `command_generator` between calls. */
+	struct CompletionState
+	{
+		CommandRegistry::CommandMap::const_iterator next;
+		CommandRegistry::CommandMap::const_iterator end;
+		std::size_t len = 0;
+	};
 
+	friend class CommandRegistry;	// predefined commands
 	friend char*  command_generator(const char* text, int state);
 	friend char** command_completion(const char* text, int start, int end);
+	friend int    history_search(int count, int key);
+	friend void   suggestion_redisplay();
+	friend int    suggestion_accept(int count, int key);
+	friend int    suggestion_newline(int count, int key);
 
-	void init(char completion_key = '\t');
+	CommandRegistry& editableCommands();
 	void exitImpl(const ArgList& args) const;
-	void updateHelp(const CLICommand* cmd);
 private:
 	bool in_exec_loop;
 	String prompt;
-	CLICommandMap commands;
+	char completion_key;
+	std::unique_ptr<LineSource> line_source;
+	CompletionState completion;
+	std::shared_ptr<History> history_file;
+	/** @brief State of `history_search` between key presses. */
+	struct HistorySearchState
+	{
+		String query;
+		String shown;	// line shown by the last search, empty if the user has changed it
+		History::EntryId last = History::npos;
+	} history_search_state;
+	std::shared_ptr<SuggestionModel> suggestions;
+	std::shared_ptr<Metrics> command_metrics;
+	std::shared_ptr<OutputCache> output_cache;
+	/** @brief Suggestion shown for the line being typed. */
+	struct SuggestionState
+	{
+		String line;
+		String text;
+	} suggestion_state;
+
+	std::shared_ptr<const CommandRegistry> registry;
+	/** @brief Same as `registry` until it's shared, nullptr afterwards. */
+	CommandRegistry* editable_registry;
 
 	TokenSpliterFunction token_spliter;
+
+	/** @brief Size of the memory lines run by `runLine` take their temporary data from first. */
+	static constexpr std::size_t LINE_BUFFER_SIZE = 16 << 10;
+	std::unique_ptr<std::byte[]> line_buffer;
+	/** @brief Memory of lines run by `runLine`, allocated from `line_buffer` until it's used up. */
+	std::pmr::monotonic_buffer_resource line_arena;
+	AllocationStats line_allocations;
+
+	mutable std::mutex jobs_mutex;	// guards the job table and creation of the pools
+	std::map<std::size_t, std::shared_ptr<Job>> job_table;
+	std::size_t next_job_id;
+	std::unique_ptr<detail::ThreadPool> job_pool;
+	/** @brief Workers of `pmap`, kept for the lifetime of the session once it has run. */
+	std::unique_ptr<detail::ThreadPool> pmap_pool;
 };
 
 template <typename T>
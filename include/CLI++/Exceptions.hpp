@@ -36,7 +36,9 @@ template<typename Target, typename Source>
 class BadLexicalCast : public std::bad_cast
 {
 public:
-	BadLexicalCast() noexcept {}
+	BadLexicalCast() noexcept : msg("bad lexical cast") {}
+	explicit BadLexicalCast(std::string msg) noexcept
+		: msg(std::move(msg)) {}
 	virtual ~BadLexicalCast() noexcept = default;
 
 	virtual const char* what() const noexcept { return msg.data(); }
@@ -0,0 +1,83 @@
+#ifndef __CLIPP_HISTORY_HEADER__
+#define __CLIPP_HISTORY_HEADER__
+
+#include "defines.hpp"
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <cstdint>
+#include <unordered_map>
+
+CLIPP_BEGIN
+
+namespace detail { class MappedFile; }
+
+/**
+ * @brief Command history persisted to an append-only file, one line per entry.
+ * @details Entries loaded from the file are used in place through a read-only memory mapping,
+ *          new entries are appended to the file as they are added. Repeated lines are kept once,
+ *          at their latest position. Searching goes through a trigram index (built lazily),
+ *          so it doesn't slow down as the history grows.
+ * @note  All methods are thread safe, views returned stay valid as long as the history exists.
+**/
+class History
+{
+public:
+	using EntryId = std::uint32_t;
+	static constexpr EntryId npos = EntryId(-1);
+public:
+	/**
+	 * @brief Open a history file, it is created if it doesn't exist.
+	 * @throws `CLIException` if the file can not be opened or mapped.
+	**/
+	explicit History(const String& path);
+	History(const History&) = delete;
+	~History();
+
+	/** @brief Append a line, lines containing a newline are ignored. */
+	void add(StringView line);
+
+	/** @brief Number of ids handed out, entries superseded by a later duplicate are included. */
+	EntryId size() const;
+	/** @brief Get an entry, empty if it has been superseded by a later duplicate. */
+	StringView entry(EntryId id) const;
+
+	/**
+	 * @brief Find the latest entry older than `before` that contains `needle`.
+	 * @return Id of the entry found, `npos` if there is none.
+	**/
+	EntryId search(StringView needle, EntryId before = npos) const;
+	/** @brief Latest entry starting with `prefix` (and longer than it), if any. */
+	std::optional<StringView> complete(StringView prefix) const;
+private:
+	/** @brief Index entries added since the last search, `mutex` must be held. */
+	void updateIndex() const;
+	/** @brief Rebuild the compact index from all entries, `mutex` must be held. */
+	void rebuildIndex() const;
+	/** @brief Record `line` which is stored in stable memory, `mutex` must be held. */
+	void insert(StringView line);
+
+	int file;
+	std::unique_ptr<detail::MappedFile> mapping;
+	std::deque<String> appended;	// entries added after the file was mapped
+
+	mutable std::mutex mutex;
+	std::vector<StringView> entries;
+	std::unordered_map<StringView, EntryId> latest;
+	// compact trigram index of entries `[0, bulk_indexed)`: ids containing trigram
+	// `index_keys[i]` are `index_ids[index_offsets[i], index_offsets[i + 1])`
+	mutable std::vector<std::uint32_t> index_keys;
+	mutable std::vector<std::uint32_t> index_offsets;
+	mutable std::vector<EntryId> index_ids;
+	mutable EntryId bulk_indexed;
+	// entries `[bulk_indexed, indexed)`, merged into the compact index once there are enough
+	mutable std::unordered_map<std::uint32_t, std::vector<EntryId>> recent_trigrams;
+	mutable EntryId indexed;
+};
+
+CLIPP_END
+
+#endif //! __CLIPP_HISTORY_HEADER__
@@ -0,0 +1,115 @@
+#ifndef __CLIPP_LINESOURCE_HEADER__
+#define __CLIPP_LINESOURCE_HEADER__
+
+#include "defines.hpp"
+
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <memory>
+#include <condition_variable>
+
+CLIPP_BEGIN
+
+/**
+ * @brief Where `CLI::exec` gets command lines from.
+ * @note  Derive from this class to drive a `CLI` from another transport, only `readLine`
+ *        has to be implemented.
+**/
+class LineSource
+{
+public:
+	virtual ~LineSource() = default;
+
+	/**
+	 * @brief Get the next line, without the trailing newline.
+	 * @param prompt prompt of the CLI, sources that are not interactive may ignore it
+	 * @param line string to store the line
+	 * @return false if there is no more input, `CLI::exec` returns then.
+	**/
+	virtual bool readLine(const String& prompt, String& line) = 0;
+	/** @brief Called with every non-empty line before it's executed. */
+	virtual void addHistory(const String&) {}
+};
+
+/** @brief Interactive input through GNU Readline, with history and completion of commands. */
+class ReadlineSource : public LineSource
+{
+public:
+	/** @param completion_key key bound to command completion */
+	explicit ReadlineSource(char completion_key = '\t');
+
+	virtual bool readLine(const String& prompt, String& line) override;
+	virtual void addHistory(const String& line) override;
+};
+
+/**
+ * @brief Read lines from a file descriptor through a large buffer, lines are cut out of it
+ *        with `memchr`, without any terminal handling.
+ * @note  A last line without a trailing newline is still returned.
+**/
+class FdLineSource : public LineSource
+{
+public:
+	/**
+	 * @param fd file descriptor to read from
+	 * @param owns_fd whether `fd` is closed when this object is destroyed
+	 * @param show_prompt whether the prompt is written to stdout before each line
+	 * @param buffer_size size of internal buffer in characters
+	**/
+	FdLineSource(int fd, bool owns_fd = false, bool show_prompt = false, std::size_t buffer_size = 1 << 16);
+	FdLineSource(const FdLineSource&) = delete;
+	virtual ~FdLineSource();
+
+	virtual bool readLine(const String& prompt, String& line) override;
+
+	int fd() const { return file; }
+private:
+	/** @brief Read more data into the buffer, return false on EOF or error. */
+	bool fill();
+
+	int file;
+	bool owns_fd;
+	bool show_prompt;
+	std::unique_ptr<CharType[]> buffer;
+	std::size_t capacity;
+	std::size_t begin;
+	std::size_t end;
+};
+
+/** @brief Raw buffered stdin, the prompt is only shown if stdin is a terminal. */
+class StdinLineSource : public FdLineSource
+{
+public:
+	StdinLineSource();
+};
+
+/**
+ * @brief Lines pushed from code, e.g. tests, benchmarks or another thread receiving commands.
+ * @details `readLine` blocks until a line is pushed or the queue is closed. Lines pushed
+ *          before `close` are still returned.
+**/
+class QueueLineSource : public LineSource
+{
+public:
+	QueueLineSource() = default;
+	/** @brief Create a queue holding `lines`, and close it unless `keep_open`. */
+	template<typename Range>
+	explicit QueueLineSource(const Range& lines, bool keep_open = false)
+		: lines(std::begin(lines), std::end(lines)), closed(!keep_open) {}
+
+	virtual bool readLine(const String& prompt, String& line) override;
+
+	void push(String line);
+	/** @brief No more lines will be pushed, `readLine` returns false once the queue is empty. */
+	void close();
+private:
+	std::mutex mutex;
+	std::condition_variable available;
+	std::deque<String> lines;
+	bool closed = false;
+};
+
+CLIPP_END
+
+#endif //! __CLIPP_LINESOURCE_HEADER__
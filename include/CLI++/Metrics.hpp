@@ -0,0 +1,106 @@
+#ifndef __CLIPP_METRICS_HEADER__
+#define __CLIPP_METRICS_HEADER__
+
+#include "defines.hpp"
+
+#include <map>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+#include <functional>
+#include <shared_mutex>
+
+CLIPP_BEGIN
+
+/**
+ * @brief Histogram of durations in nanoseconds with log-linear buckets, like HdrHistogram.
+ * @details Every power of two is split into `SUB_BUCKETS` buckets, so values are kept with a
+ *          relative error below `1 / SUB_BUCKETS` over the whole range of `uint64_t`. Recording
+ *          is a couple of relaxed atomic increments, it can be done from any thread.
+**/
+class LatencyHistogram
+{
+public:
+	static constexpr unsigned SUB_BUCKET_BITS = 4;
+	static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+	static constexpr unsigned BUCKETS = SUB_BUCKETS * (64 - SUB_BUCKET_BITS + 1);
+public:
+	void record(std::uint64_t value);
+	void reset();
+
+	std::uint64_t count() const { return total.load(std::memory_order_relaxed); }
+	std::uint64_t sum() const { return value_sum.load(std::memory_order_relaxed); }
+	std::uint64_t max() const { return value_max.load(std::memory_order_relaxed); }
+	/** @brief Value below which a fraction `q` of the recorded values are, `0` if nothing is recorded. */
+	std::uint64_t percentile(double q) const;
+private:
+	static unsigned bucketOf(std::uint64_t value);
+	/** @brief Middle of the range of values counted by a bucket. */
+	static std::uint64_t valueOf(unsigned bucket);
+
+	std::array<std::atomic<std::uint64_t>, BUCKETS> buckets{};
+	std::atomic<std::uint64_t> total{ 0 };
+	std::atomic<std::uint64_t> value_sum{ 0 };
+	std::atomic<std::uint64_t> value_max{ 0 };
+};
+
+/** @brief Counters of a single command, updated after every invocation. */
+struct CommandMetrics
+{
+	std::atomic<std::uint64_t> invocations{ 0 };
+	/** @brief Invocations by return code, codes outside `[0, 255]` are counted modulo 256 like exit codes. */
+	std::array<std::atomic<std::uint64_t>, 256> return_codes{};
+	/** @brief Bytes the command read from its pipeline input, input that isn't seekable (e.g. stdin) is not counted. */
+	std::atomic<std::uint64_t> bytes_read{ 0 };
+	/** @brief Bytes the command wrote through `Pipeline::write`, e.g. with `CLI::print`. */
+	std::atomic<std::uint64_t> bytes_written{ 0 };
+	LatencyHistogram wall_time;
+	LatencyHistogram cpu_time;
+
+	void reset();
+};
+
+/**
+ * @brief Metrics of every command run by the sessions that share this object.
+ * @note  All methods are thread safe.
+**/
+class Metrics
+{
+public:
+	/** @brief Measurements of a single invocation. */
+	struct Sample
+	{
+		int return_code;
+		std::uint64_t wall_ns;
+		std::uint64_t cpu_ns;
+		std::uint64_t bytes_read;
+		std::uint64_t bytes_written;
+	};
+public:
+	/** @brief Get metrics of a command, they are created on first use. References stay valid. */
+	CommandMetrics& command(StringView name);
+	void record(StringView name, const Sample& sample);
+	/** @brief Zero all counters, commands seen so far are kept. */
+	void reset();
+
+	/** @brief Call `fn(name, metrics)` for every command, in order of name. */
+	void forEach(const std::function<void(StringView, const CommandMetrics&)>& fn) const;
+
+	/** @brief Write all metrics in Prometheus text exposition format. */
+	void writePrometheus(std::basic_ostream<CharType>& out) const;
+	/**
+	 * @brief Write all metrics in Prometheus text exposition format to a file, which is replaced
+	 *        at once so that a collector never reads it half written.
+	 * @throws `CLIException` if the file can not be written.
+	**/
+	void exportPrometheus(const String& path) const;
+private:
+	mutable std::shared_mutex mutex;
+	std::map<String, std::unique_ptr<CommandMetrics>, std::less<>> commands;
+};
+
+CLIPP_END
+
+#endif //! __CLIPP_METRICS_HEADER__
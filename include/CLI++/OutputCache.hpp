@@ -0,0 +1,86 @@
+#ifndef __CLIPP_OUTPUT_CACHE_HEADER__
+#define __CLIPP_OUTPUT_CACHE_HEADER__
+
+#include "defines.hpp"
+
+#include <list>
+#include <mutex>
+#include <memory>
+#include <span>
+#include <cstdint>
+#include <unordered_map>
+
+CLIPP_BEGIN
+
+/**
+ * @brief Outputs of pure commands (see `CLICommand::setPure`), keyed by their arguments and input.
+ * @details Entries are evicted least recently used first once their total size exceeds the
+ *          capacity. Arguments and input are compared as they are: entries are found by the
+ *          size and a 64 bit hash of their input, which is kept with the output and compared
+ *          on a hit. Inputs count towards the capacity.
+ * @note  All methods are thread safe, so a cache can be shared by sessions.
+**/
+class OutputCache
+{
+public:
+	/** @brief Output and return code of an invocation. */
+	struct Entry
+	{
+		String output;
+		int return_code;
+	};
+	struct Statistics
+	{
+		std::uint64_t hits;
+		std::uint64_t misses;
+		std::size_t entries;
+		std::size_t bytes;
+	};
+public:
+	/** @param capacity maximum total size of cached outputs and their keys, in characters */
+	explicit OutputCache(std::size_t capacity = std::size_t(64) << 20) : capacity(capacity) {}
+	OutputCache(const OutputCache&) = delete;
+
+	/**
+	 * @brief Find output of a command called with `args` (its name being the first one) on `input`.
+	 * @return nullptr on a miss, the entry found stays valid even if it's evicted meanwhile.
+	**/
+	std::shared_ptr<const Entry> find(std::span<const StringView> args, StringView input);
+	/** @brief Keep output of an invocation, those larger than the whole capacity with their input are not kept. */
+	void insert(std::span<const StringView> args, StringView input, Entry entry);
+
+	/** @brief Drop outputs of a command. */
+	void invalidate(StringView command);
+	/** @brief Drop every output. */
+	void clear();
+
+	Statistics statistics() const;
+private:
+	static String makeKey(std::span<const StringView> args, StringView input);
+	/** @brief Name of the command a key belongs to. */
+	static StringView commandOf(const String& key);
+	/** @brief Remove least recently used entries until the size is within capacity, `mutex` must be held. */
+	void evict();
+
+	struct Node
+	{
+		String key;
+		String input;
+		std::shared_ptr<const Entry> entry;
+
+		std::size_t size() const { return key.size() + input.size() + entry->output.size(); }
+	};
+	using NodeList = std::list<Node>;
+
+	std::size_t capacity;
+	mutable std::mutex mutex;
+	NodeList lru;	// most recently used first
+	std::unordered_map<StringView, NodeList::iterator> index;	// keys refer to `Node::key`
+	std::size_t bytes = 0;
+	std::uint64_t hits = 0;
+	std::uint64_t misses = 0;
+};
+
+CLIPP_END
+
+#endif //! __CLIPP_OUTPUT_CACHE_HEADER__
@@ -0,0 +1,108 @@
+#ifndef __CLIPP_SERVER_HEADER__
+#define __CLIPP_SERVER_HEADER__
+
+#include "CLI++.hpp"
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+CLIPP_BEGIN
+
+/**
+ * @brief Serve CLI sessions to clients connecting to a Unix domain socket or a TCP port on
+ *        the loopback interface.
+ * @details One thread multiplexes every connection with `epoll`. Each connection gets its own
+ *          `CLI` session running commands of a shared `CommandRegistry`, lines received are run
+ *          in order on a pool of worker threads, and everything the session prints is streamed
+ *          back over the connection. A session ends when its client disconnects or runs `exit`.
+ * @note  Sessions have no stdin, commands reading input only see what their pipeline provides.
+**/
+class CLIServer
+{
+public:
+	/**
+	 * @param commands commands available to every session
+	 * @param threads  number of threads running command lines, `0` means number of hardware threads
+	**/
+	explicit CLIServer(std::shared_ptr<const CommandRegistry> commands, std::size_t threads = 0);
+	CLIServer(const CLIServer&) = delete;
+	/** @brief Close every connection, after command lines that are running have finished. */
+	~CLIServer();
+
+	/**
+	 * @brief Accept connections on a Unix domain socket, a stale socket file at `path` is replaced.
+	 * @throws `CLIException` if the socket can not be created.
+	**/
+	void listenUnix(const String& path);
+	/**
+	 * @brief Accept connections on `127.0.0.1:port`, `0` picks a free port.
+	 * @throws `CLIException` if the socket can not be created.
+	 * @return The port actually listened on.
+	**/
+	std::uint16_t listenTcp(std::uint16_t port);
+
+	/** @brief Prompt sent when a client connects and after each of its command lines, none by default. */
+	void setPrompt(const String& prompt) { this->prompt = prompt; }
+	/** @brief Metrics of commands run by all sessions, `stats` of any session shows them. */
+	const std::shared_ptr<Metrics>& metrics() const { return session_metrics; }
+	/** @brief Cache of outputs of pure commands shared by all sessions. */
+	const std::shared_ptr<OutputCache>& outputCache() const { return session_cache; }
+#if CLIPP_ENABLE_TRACING
+	/**
+	 * @brief Add a trace hook to every session, see `CLI::addTraceHook`. It's called from worker
+	 *        threads, concurrently for different sessions.
+	 * @note  Only sessions of connections accepted afterwards get the hook.
+	**/
+	void addTraceHook(TraceHook hook) { trace_hooks.push_back(std::move(hook)); }
+#endif
+
+	/**
+	 * @brief Run the event loop on the calling thread until `stop` is called.
+	 * @throws `CLIException` if `epoll` fails.
+	**/
+	void run();
+	/** @brief Make `run` return, can be called from any thread. */
+	void stop();
+private:
+	struct Connection;
+	class SessionOutputBuf;
+
+	void accept(int listener);
+	void receive(const std::shared_ptr<Connection>& conn);
+	/** @brief Write pending output of `conn`, close it once everything is sent if it's finished. */
+	void send(const std::shared_ptr<Connection>& conn);
+	void close(const std::shared_ptr<Connection>& conn);
+	/** @brief Wait for what `conn` needs: input if `reading`, room to write if output is pending, else nothing. */
+	void watch(const std::shared_ptr<Connection>& conn, bool reading);
+	/** @brief Run command lines queued on `conn` on a worker thread, one line after another. */
+	void runLines(std::shared_ptr<Connection> conn);
+	/** @brief Ask the event loop to send output of `conn`, can be called from any thread. */
+	void wake(const std::shared_ptr<Connection>& conn);
+
+	std::shared_ptr<const CommandRegistry> registry;
+	std::unique_ptr<detail::ThreadPool> workers;
+	String prompt;
+	std::shared_ptr<Metrics> session_metrics;
+	std::shared_ptr<OutputCache> session_cache;
+#if CLIPP_ENABLE_TRACING
+	std::vector<TraceHook> trace_hooks;
+#endif
+
+	int epoll_fd;
+	int wake_fd;
+	std::vector<int> listeners;
+	std::vector<String> socket_paths;
+	std::map<int, std::shared_ptr<Connection>> connections;
+
+	std::mutex wake_mutex;
+	std::vector<std::weak_ptr<Connection>> woken;
+	std::atomic<bool> stopping;
+};
+
+CLIPP_END
+
+#endif //! __CLIPP_SERVER_HEADER__
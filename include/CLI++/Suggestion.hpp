@@ -0,0 +1,74 @@
+#ifndef __CLIPP_SUGGESTION_HEADER__
+#define __CLIPP_SUGGESTION_HEADER__
+
+#include "defines.hpp"
+
+#include <mutex>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+
+CLIPP_BEGIN
+
+/**
+ * @brief Predicts how a partially typed command line goes on, from command lines seen before.
+ * @details Lines are split into words at whitespace. For every context of one and two preceding
+ *          words, the model counts which word follows and keeps the most frequent one at hand,
+ *          so a suggestion costs a few hash lookups per word whatever the number of lines learnt.
+ *          Counts are updated as lines are learnt. A suggestion is only extended by words
+ *          that follow their context in most of the lines learnt.
+ * @note  All methods are thread safe, so a model can be shared by sessions.
+**/
+class SuggestionModel
+{
+public:
+	/**
+	 * @param max_words maximum number of words a suggestion extends the line by
+	**/
+	explicit SuggestionModel(std::size_t max_words = 16) : max_words(max_words) {}
+
+	/** @brief Count words of a command line. */
+	void learn(StringView line);
+	/** @brief Number of lines learnt. */
+	std::size_t size() const;
+
+	/**
+	 * @brief Suggest how `prefix` goes on, the last word of `prefix` is completed first unless
+	 *        it ends with whitespace.
+	 * @return Text to be appended to `prefix`, empty if there's no suggestion.
+	**/
+	String suggest(StringView prefix) const;
+private:
+	/** @brief Allows looking up `String` keys with a `StringView`, without creating a `String`. */
+	struct KeyHash
+	{
+		using is_transparent = void;
+		std::size_t operator()(StringView key) const { return std::hash<StringView>()(key); }
+	};
+	template<typename Value>
+	using KeyMap = std::unordered_map<String, Value, KeyHash, std::equal_to<>>;
+
+	struct Followers
+	{
+		KeyMap<std::uint32_t> counts;
+		const String* best = nullptr;	// key of the largest count, for contexts that are complete
+		std::uint32_t best_count = 0;
+		std::uint32_t total = 0;
+	};
+
+	/**
+	 * @brief Most frequent word following the context that starts with `partial`.
+	 * @param confident only return a word that follows the context most of the time
+	 * @return nullptr if there's no such word.
+	**/
+	const String* predict(StringView before_last, StringView last, StringView partial, bool confident) const;
+
+	std::size_t max_words;
+	mutable std::mutex mutex;
+	KeyMap<Followers> contexts;
+	std::size_t lines = 0;
+};
+
+CLIPP_END
+
+#endif //! __CLIPP_SUGGESTION_HEADER__
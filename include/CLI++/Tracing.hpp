@@ -0,0 +1,59 @@
+#ifndef __CLIPP_TRACING_HEADER__
+#define __CLIPP_TRACING_HEADER__
+
+#include "defines.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+/**
+ * Trace hooks are only compiled in if `CLIPP_ENABLE_TRACING` is defined to a non-zero value
+ * (cmake option `CLIPP_ENABLE_TRACING`), otherwise `CLI` has no hook and no call site is left.
+ * The library and programs using it must be compiled with the same value.
+**/
+#ifndef CLIPP_ENABLE_TRACING
+#define CLIPP_ENABLE_TRACING 0
+#endif
+
+CLIPP_BEGIN
+
+class CLI;
+
+/**
+ * @brief A point in the execution of a command line, trace hooks get one before and one
+ *        after each step, on the thread running that step.
+ * @details Steps of a line are nested: `Parse`, then every `Pipeline` of the `&&`/`||` list,
+ *          each of them running its `Command` stages one after another. Branches of a fan-out
+ *          group run on threads of their own and number their pipelines from `0` again, `pmap`
+ *          invocations are numbered as stages of pipeline `0` in the order of their input.
+**/
+struct TraceEvent
+{
+	enum class Kind : std::uint8_t
+	{
+		Parse,		// splitting a line into pipelines, `name` is the line
+		Pipeline,	// a pipeline of the `&&`/`||` list, `name` is its first command
+		Command,	// a stage of a pipeline, `name` is the command (`!prog` for external programs)
+	};
+	enum class Phase : std::uint8_t { Begin, End };
+
+	Kind kind;
+	Phase phase;
+	/** @brief `std::chrono::steady_clock` time in nanoseconds. */
+	std::uint64_t timestamp;
+	/** @brief Index of the pipeline in its `&&`/`||` list. */
+	std::size_t pipeline;
+	/** @brief Index of the stage in its pipeline, consecutive external programs are a single stage. */
+	std::size_t stage;
+	StringView name;
+	/** @brief Return code of the step, only set on `End`. A step that throws ends with `1`. */
+	int return_code;
+};
+
+/** @brief Called with the session running a step, must not throw. */
+using TraceHook = std::function<void(const CLI&, const TraceEvent&)>;
+
+CLIPP_END
+
+#endif //! __CLIPP_TRACING_HEADER__
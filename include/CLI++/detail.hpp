@@ -6,6 +6,7 @@
 #include <fmt/color.h>
 #include <cstdint>
 #include <vector>
+#include <memory_resource>
 #include <algorithm>
 
 
@@ -74,10 +75,36 @@ inline const wchar_t* convert_str<wchar_t>(const char* str, std::size_t len)
 
 /**
  * @brief Split string into bash-like tokens.
- * @note  Special operators like `|`, `||` and `&&` won't be recognize if no white spaces are around them,
- *        e.g. "echo 1||echo 2" will be split into {"echo", "1||echo", "2"}
+ * @note  Special operators `|`, `||`, `&&`, `|>`, `<`, `>`, `>>`, `(` and `)` are always split into their
+ *        own tokens, e.g. "echo 1||echo 2>out" will be split into {"echo", "1", "||", "echo", "2", ">", "out"}.
+ *        `,` is split into its own token only inside parentheses.
 **/
 std::vector<String> split_token(StringView cmd, ArgvError* err = nullptr);
+/**
+ * @brief Split string into bash-like tokens as above, without allocating anything but from `resource`.
+ * @return Tokens referring to a copy of `cmd` allocated from `resource`, which has to outlive them.
+**/
+std::pmr::vector<StringView> split_token(StringView cmd, std::pmr::memory_resource* resource, ArgvError* err = nullptr);
+
+/**
+ * @brief Split a NUL terminated string into the tokens of `split_token` one at a time, without allocating.
+ * @note  Tokens are unquoted in place, so `text` is modified and the tokens refer to it. A character
+ *        is only written if unquoting moves it, i.e. text without quotes or escapes is left untouched.
+**/
+class TokenScanner
+{
+public:
+	explicit TokenScanner(CharType* text) : scan(text), dest(text) {}
+
+	/** @brief Get the next token, return false at the end of the text or after an error. */
+	bool next(StringView& token);
+	ArgvError error() const { return err; }
+private:
+	const CharType* scan;
+	CharType* dest;	// never passes `scan`, a token takes at most as many characters as it's made of
+	int depth = 0;	// level of parentheses, `,` is only an operator inside them
+	ArgvError err;
+};
 
 /** @brief Check if a string is empty, or its characters are all white spaces (i.e. character that `std::isspace` returns true). */
 template<typename CharT>
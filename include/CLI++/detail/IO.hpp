@@ -0,0 +1,142 @@
+#ifndef __CLIPP_DETAIL_IO_HEADER__
+#define __CLIPP_DETAIL_IO_HEADER__
+
+#include "../defines.hpp"
+
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <optional>
+
+CLIPP_BEGIN NAMESPACE_BEGIN(detail)
+
+/**
+ * @brief Read-only stream buffer over a range of characters, nothing is copied.
+ * @note  The caller need to ensure the life time of the underlying characters.
+**/
+class ViewStreamBuf : public std::basic_streambuf<CharType>
+{
+public:
+	explicit ViewStreamBuf(StringView view = StringView());
+
+	/** @brief Characters that have not been read yet. */
+	StringView remaining() const { return StringView(gptr(), egptr() - gptr()); }
+	/** @brief The whole underlying range. */
+	StringView view() const { return StringView(eback(), egptr() - eback()); }
+protected:
+	virtual std::streamsize showmanyc() override;
+	virtual pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+	virtual pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+};
+
+/** @brief Input stream over a range of characters, see `ViewStreamBuf`. */
+class ViewInputStream : public std::basic_istream<CharType>
+{
+public:
+	explicit ViewInputStream(StringView view = StringView())
+		: std::basic_istream<CharType>(nullptr), buf(view) { this->init(&buf); }
+
+	ViewStreamBuf* rdbuf() { return &buf; }
+private:
+	ViewStreamBuf buf;
+};
+
+/**
+ * @brief Get characters of `in` that have not been read yet. Nothing is copied if `in` reads
+ *        from a `std::stringbuf` or a `ViewStreamBuf`.
+ * @param in stream to get characters from, its position is not changed
+ * @param storage holds the characters if they have to be copied
+**/
+StringView unread_view(std::basic_istream<CharType>& in, String& storage);
+/** @brief Same as above, but nothing is returned if the characters would have to be copied. */
+std::optional<StringView> unread_view(std::basic_istream<CharType>& in);
+
+/**
+ * @brief Memory mapping of a whole file, read-only unless it's a private copy.
+ * @throws `CLIException` if the file can not be opened or mapped.
+**/
+class MappedFile
+{
+public:
+	explicit MappedFile(const String& path) : MappedFile(path, false) {}
+	/**
+	 * @param private_copy map a copy of the file that can be written, followed by a NUL character.
+	 *        Pages are only copied when they are written, writes never reach the file.
+	**/
+	MappedFile(const String& path, bool private_copy);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	StringView view() const { return StringView(data, size / sizeof(CharType)); }
+	/** @brief Characters of a private copy, NUL terminated. */
+	CharType* text() { return data; }
+private:
+	CharType* data;
+	std::size_t size;
+	std::size_t mapped;	// bytes to unmap, a private copy has room for the NUL after the file
+};
+
+/** @brief Input stream over a memory mapped file, see `MappedFile`. */
+class MappedInputStream : public std::basic_istream<CharType>
+{
+public:
+	explicit MappedInputStream(const String& path)
+		: std::basic_istream<CharType>(nullptr), file(path), buf(file.view()) { this->init(&buf); }
+
+	ViewStreamBuf* rdbuf() { return &buf; }
+private:
+	MappedFile file;
+	ViewStreamBuf buf;
+};
+
+/**
+ * @brief Output stream buffer that writes to a file descriptor.
+ * @details Data is collected into a large buffer, which is written with a single `writev`
+ *          call together with the next chunk once it would overflow. Chunks larger than the
+ *          buffer itself are never copied into it.
+**/
+class FileOutputBuf : public std::basic_streambuf<CharType>
+{
+public:
+	/**
+	 * @param fd file descriptor to write to
+	 * @param owns_fd whether `fd` is closed when this object is destroyed
+	 * @param buffer_size size of internal buffer in characters
+	**/
+	FileOutputBuf(int fd, bool owns_fd, std::size_t buffer_size = 1 << 20);
+	FileOutputBuf(const FileOutputBuf&) = delete;
+	virtual ~FileOutputBuf();
+
+	int fd() const { return file; }
+protected:
+	virtual int_type overflow(int_type ch) override;
+	virtual std::streamsize xsputn(const char_type* s, std::streamsize n) override;
+	virtual int sync() override;
+private:
+	/** @brief Write buffered data followed by `[s, s + n)`, return false on error. */
+	bool flush(const char_type* s, std::size_t n);
+
+	int file;
+	bool owns_fd;
+	char_type* buffer;
+	std::size_t capacity;
+};
+
+/**
+ * @brief Output stream that creates (or truncates) a file, or appends to it.
+ * @throws `CLIException` if the file can not be opened.
+**/
+class FileOutputStream : public std::basic_ostream<CharType>
+{
+public:
+	FileOutputStream(const String& path, bool append);
+
+	FileOutputBuf* rdbuf() { return &buf; }
+private:
+	FileOutputBuf buf;
+};
+
+NAMESPACE_END(detail) CLIPP_END
+
+#endif //! __CLIPP_DETAIL_IO_HEADER__
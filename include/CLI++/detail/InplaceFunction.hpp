@@ -0,0 +1,125 @@
+#ifndef __CLIPP_DETAIL_INPLACE_FUNCTION_HEADER__
+#define __CLIPP_DETAIL_INPLACE_FUNCTION_HEADER__
+
+#include "../defines.hpp"
+
+#include <new>
+#include <cstddef>
+#include <utility>
+#include <concepts>
+#include <functional>
+#include <type_traits>
+
+CLIPP_BEGIN NAMESPACE_BEGIN(detail)
+
+template<typename Signature, std::size_t Capacity = 48>
+class InplaceFunction;
+
+/**
+ * @brief Type erased callable like `std::function`, but callables up to `Capacity` bytes are
+ *        always kept in the object itself, only larger ones (or ones that may throw when moved)
+ *        are allocated on the heap.
+ * @details The callable is called as const, like a `const std::function`. Objects are move only,
+ *          a moved-from object is empty.
+**/
+template<typename R, typename... Args, std::size_t Capacity>
+class InplaceFunction<R(Args...), Capacity>
+{
+public:
+	InplaceFunction() noexcept = default;
+	template<typename Func>
+		requires (!std::same_as<std::remove_cvref_t<Func>, InplaceFunction>)
+			&& std::is_invocable_r_v<R, const std::decay_t<Func>&, Args...>
+	InplaceFunction(Func&& f)
+	{
+		using Stored = std::decay_t<Func>;
+		if constexpr (stored_inline<Stored>)
+			::new (static_cast<void*>(storage)) Stored(std::forward<Func>(f));
+		else
+			::new (static_cast<void*>(storage)) Stored*(new Stored(std::forward<Func>(f)));
+		ops = &operations<Stored>;
+	}
+	InplaceFunction(InplaceFunction&& other) noexcept
+	{
+		if (other.ops != nullptr)
+		{
+			other.ops->relocate(storage, other.storage);
+			ops = std::exchange(other.ops, nullptr);
+		}
+	}
+	InplaceFunction& operator=(InplaceFunction&& other) noexcept
+	{
+		if (this != &other)
+		{
+			this->~InplaceFunction();
+			::new (this) InplaceFunction(std::move(other));
+		}
+		return *this;
+	}
+	~InplaceFunction()
+	{
+		if (ops != nullptr)
+			ops->destroy(storage);
+	}
+
+	explicit operator bool() const noexcept { return ops != nullptr; }
+
+	/** @throws `std::bad_function_call` if empty */
+	R operator()(Args... args) const
+	{
+		if (ops == nullptr)
+			throw std::bad_function_call();
+		return ops->call(storage, std::forward<Args>(args)...);
+	}
+private:
+	template<typename T>
+	static constexpr bool stored_inline = sizeof(T) <= Capacity
+		&& alignof(T) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<T>;
+
+	struct Operations
+	{
+		R (*call)(const void* self, Args&&... args);
+		// move the callable from `src` to uninitialized `dst`, and destroy `src`
+		void (*relocate)(void* dst, void* src) noexcept;
+		void (*destroy)(void* self) noexcept;
+	};
+
+	template<typename T>
+	static const T& target(const void* self)
+	{
+		if constexpr (stored_inline<T>)
+			return *std::launder(static_cast<const T*>(self));
+		else
+			return **std::launder(static_cast<T* const*>(self));
+	}
+
+	template<typename T>
+	static constexpr Operations operations = {
+		[](const void* self, Args&&... args) -> R {
+			return std::invoke(target<T>(self), std::forward<Args>(args)...);
+		},
+		[](void* dst, void* src) noexcept {
+			if constexpr (stored_inline<T>)
+			{
+				T* from = std::launder(static_cast<T*>(src));
+				::new (dst) T(std::move(*from));
+				from->~T();
+			}
+			else
+				::new (dst) T*(*std::launder(static_cast<T**>(src)));
+		},
+		[](void* self) noexcept {
+			if constexpr (stored_inline<T>)
+				std::launder(static_cast<T*>(self))->~T();
+			else
+				delete *std::launder(static_cast<T**>(self));
+		},
+	};
+
+	alignas(std::max_align_t) std::byte storage[Capacity < sizeof(void*) ? sizeof(void*) : Capacity];
+	const Operations* ops = nullptr;
+};
+
+NAMESPACE_END(detail) CLIPP_END
+
+#endif //! __CLIPP_DETAIL_INPLACE_FUNCTION_HEADER__
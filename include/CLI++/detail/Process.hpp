@@ -0,0 +1,72 @@
+#ifndef __CLIPP_DETAIL_PROCESS_HEADER__
+#define __CLIPP_DETAIL_PROCESS_HEADER__
+
+#include "../defines.hpp"
+
+#include <vector>
+#include <mutex>
+#include <istream>
+#include <ostream>
+
+#include <signal.h>
+#include <sys/types.h>
+
+CLIPP_BEGIN NAMESPACE_BEGIN(detail)
+
+/** @brief Keeps track of process groups of running external programs, so they can be signaled together. */
+class ProcessGroup
+{
+public:
+	/** @brief Register a process group, it is signaled at once if `kill` has been called before. */
+	void add(pid_t pgid);
+	/** @brief Forget a process group whose processes have all been reaped. */
+	void remove(pid_t pgid);
+	/** @brief Send `sig` to every registered process group, and to those registered later. */
+	void kill(int sig = SIGTERM);
+private:
+	std::mutex mutex;
+	std::vector<pid_t> groups;
+	int killed_with = 0;
+};
+
+/**
+ * @brief Describes where a chain of external processes reads from and writes to.
+ * @note  For both ends, a stream takes priority over a file descriptor. If neither is
+ *        specified, children inherit the standard input or output of this process.
+**/
+struct ProcessIO
+{
+	/** @brief File descriptor handed to the first process as its stdin, `-1` to inherit. */
+	int in_fd = -1;
+	/** @brief Stream whose remaining contents are fed to the first process through a pipe. */
+	std::basic_istream<CharType>* in = nullptr;
+
+	/** @brief File descriptor handed to the last process as its stdout, `-1` to inherit. */
+	int out_fd = -1;
+	/** @brief Stream that receives everything the last process writes to its stdout. */
+	std::basic_ostream<CharType>* out = nullptr;
+
+	/**
+	 * @brief If not `nullptr`, the processes are put into a new process group, which is
+	 *        registered here while they are running.
+	**/
+	ProcessGroup* group = nullptr;
+};
+
+/**
+ * @brief Spawn every argument vector in `chain` with `posix_spawnp`, connect them with pipes
+ *        and wait until all of them exit.
+ * @details Adjacent processes share one pipe, so data passed between them never goes through
+ *          this process. Contents of `ProcessIO::in` are pushed into the first pipe with
+ *          `vmsplice` when the platform supports it, and with `write` otherwise.
+ * @note  If a program can not be spawned, an error message is printed to stderr and its stage
+ *        reports `127`, just like a shell would.
+ * @param chain argument vectors of each process, `chain[i][0]` is the program name
+ * @param io    input and output of the whole chain
+ * @return Bitwise or of all exit codes, `128 + signal` for processes killed by a signal.
+**/
+int run_process_chain(const std::vector<std::vector<String>>& chain, const ProcessIO& io);
+
+NAMESPACE_END(detail) CLIPP_END
+
+#endif //! __CLIPP_DETAIL_PROCESS_HEADER__
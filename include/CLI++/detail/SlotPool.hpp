@@ -0,0 +1,72 @@
+#ifndef __CLIPP_DETAIL_SLOT_POOL_HEADER__
+#define __CLIPP_DETAIL_SLOT_POOL_HEADER__
+
+#include "../defines.hpp"
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <utility>
+#include <functional>
+
+CLIPP_BEGIN NAMESPACE_BEGIN(detail)
+
+/**
+ * @brief Uninitialized storage for objects of type `T`, allocated `ChunkSize` slots at a time so
+ *        that objects are laid out next to each other. Slots never move, freed ones are reused.
+ * @note  The pool doesn't construct nor destroy objects, every object must be destroyed before
+ *        the pool is. Not thread safe.
+**/
+template<typename T, std::size_t ChunkSize = 32>
+class SlotPool
+{
+public:
+	SlotPool() = default;
+	SlotPool(const SlotPool&) = delete;
+	SlotPool& operator=(const SlotPool&) = delete;
+
+	/** @brief Get storage for an object of type `T`. */
+	void* allocate()
+	{
+		if (free_list != nullptr)
+			return std::exchange(free_list, free_list->next);
+		if (chunk_used == ChunkSize)
+		{
+			chunks.emplace_back(new Slot[ChunkSize]);
+			chunk_used = 0;
+		}
+		return &chunks.back()[chunk_used++];
+	}
+	/** @brief Give back storage returned by `allocate`, the object in it must be destroyed already. */
+	void deallocate(void* p) noexcept
+	{
+		Slot* slot = static_cast<Slot*>(p);
+		slot->next = free_list;
+		free_list = slot;
+	}
+	/** @brief Check if `p` points to a slot of this pool. */
+	bool owns(const void* p) const noexcept
+	{
+		std::less<const void*> less;
+		for (auto& chunk : chunks)
+		{
+			if (!less(p, chunk.get()) && less(p, chunk.get() + ChunkSize))
+				return true;
+		}
+		return false;
+	}
+private:
+	union Slot
+	{
+		Slot* next;
+		alignas(T) std::byte storage[sizeof(T)];
+	};
+
+	std::vector<std::unique_ptr<Slot[]>> chunks;
+	std::size_t chunk_used = ChunkSize;	// slots handed out from the last chunk
+	Slot* free_list = nullptr;
+};
+
+NAMESPACE_END(detail) CLIPP_END
+
+#endif //! __CLIPP_DETAIL_SLOT_POOL_HEADER__
@@ -0,0 +1,60 @@
+#ifndef __CLIPP_DETAIL_THREADPOOL_HEADER__
+#define __CLIPP_DETAIL_THREADPOOL_HEADER__
+
+#include "../defines.hpp"
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <functional>
+#include <condition_variable>
+
+CLIPP_BEGIN NAMESPACE_BEGIN(detail)
+
+/** @brief Fixed number of worker threads running tasks in submission order. */
+class ThreadPool
+{
+public:
+	using Task = std::function<void()>;
+public:
+	explicit ThreadPool(std::size_t threads);
+	ThreadPool(const ThreadPool&) = delete;
+	/** @brief Run all tasks still in the queue, then join every worker. */
+	~ThreadPool();
+
+	/** @brief Queue a task, it runs as soon as a worker is free. */
+	void submit(Task task);
+
+	std::size_t size() const { return workers.size(); }
+private:
+	void work();
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<Task> tasks;
+	std::vector<std::thread> workers;
+	bool stopping;
+};
+
+/**
+ * @brief Call `task(worker, index)` for every index in `[0, count)` on `threads` worker threads.
+ * @details Each worker starts with an equal share of contiguous indices and takes them from the
+ *          front. A worker that runs out of work steals the back half of the largest remaining
+ *          share, so uneven tasks still keep every worker busy.
+ * @note  The calling thread is used as worker `0`, the others run on `pool`, so there are at most
+ *        `pool.size() + 1` of them. Workers the pool doesn't start before the calling thread runs
+ *        out of work are skipped, a busy pool (or a call from one of its own workers) slows the
+ *        call down but can't block it. If a task throws, remaining tasks are skipped and the first
+ *        exception is rethrown after all workers finish.
+ * @param pool   threads running the workers other than `0`
+ * @param count  number of tasks
+ * @param threads number of workers, `worker` passed to `task` is in `[0, threads)`
+ * @param task   function to run
+**/
+void parallel_for(ThreadPool& pool, std::size_t count, std::size_t threads,
+                  const std::function<void(std::size_t worker, std::size_t index)>& task);
+
+NAMESPACE_END(detail) CLIPP_END
+
+#endif //! __CLIPP_DETAIL_THREADPOOL_HEADER__
@@ -2,6 +2,15 @@
 #define __CLIPP_DETAIL_TYPES_HEADER__
 
 #include "../defines.hpp"
+#include "../Exceptions.hpp"
+
+#include <vector>
+#include <sstream>
+#include <typeinfo>
+#include <algorithm>
+#include <charconv>
+#include <concepts>
+#include <system_error>
 
 #ifdef __GNUC__
 #  include <cxxabi.h>
@@ -55,10 +64,111 @@ concept LexicalCastSource = requires (std::basic_ostream<CharType> ss, T src)
 template<typename Target, typename Source>
 struct UsesCustomCast { static constexpr bool value = false; };
 
+/**
+ * @brief Conversion from text to `T` without iostreams, `LexicalCast` uses it for any `T` it's
+ *        specialized for. Specializations provide `static T parse(StringView text)`, which
+ *        throws `BadLexicalCast<T, StringView>` unless the whole `text` is a valid `T`.
+ * @note  Specialized for arithmetic types with `std::from_chars`. `bool` is one of `true`,
+ *        `false`, `1` or `0`, character types are a single character.
+**/
+template<typename T>
+struct FromString;
+
+/**
+ * @brief Conversion from `T` to text without iostreams, `LexicalCast` uses it for any `T` it's
+ *        specialized for. Specializations provide `static void append(String& out, const T& value)`.
+ * @note  Specialized for arithmetic types with `std::to_chars`.
+**/
+template<typename T>
+struct ToString;
+
+template<typename T>
+concept HasFromString = requires (StringView text)
+{ { FromString<T>::parse(text) } -> std::convertible_to<T>; };
+
+template<typename T>
+concept HasToString = requires (String& out, const T& value)
+{ ToString<T>::append(out, value); };
+
+template<typename T>
+concept CharacterType = std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char>;
+
+template<typename T>
+concept NumberType = std::is_arithmetic_v<T> && !CharacterType<T> && !std::is_same_v<T, bool>;
+
+template<NumberType T>
+struct FromString<T>
+{
+	static T parse(StringView text)
+	{
+		const char* first = text.data();
+		const char* last = first + text.size();
+		// `std::from_chars` takes no plus sign
+		if (last - first > 1 && first[0] == '+' && first[1] != '-')
+			++first;
+		T value{};
+		auto [end, error] = std::from_chars(first, last, value);
+		if (error == std::errc::result_out_of_range)
+			throw BadLexicalCast<T, StringView>(fmt::format("\"{}\" is out of range of {}", text, NameOfType<T>));
+		if (error != std::errc() || end != last)
+			throw BadLexicalCast<T, StringView>(fmt::format("\"{}\" is not a valid {}", text, NameOfType<T>));
+		return value;
+	}
+};
+
+template<>
+struct FromString<bool>
+{
+	static bool parse(StringView text)
+	{
+		if (text == "true" || text == "1")
+			return true;
+		if (text == "false" || text == "0")
+			return false;
+		throw BadLexicalCast<bool, StringView>(fmt::format("\"{}\" is not a valid bool, expecting true, false, 1 or 0", text));
+	}
+};
+
+template<CharacterType T>
+struct FromString<T>
+{
+	static T parse(StringView text)
+	{
+		if (text.size() != 1)
+			throw BadLexicalCast<T, StringView>(fmt::format("\"{}\" is not a single character", text));
+		return T(text.front());
+	}
+};
+
+template<NumberType T>
+struct ToString<T>
+{
+	static void append(String& out, const T& value)
+	{
+		char buffer[128];	// enough for the shortest representation of any arithmetic type
+		auto [end, error] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+		out.append(buffer, end);
+	}
+};
+
+template<>
+struct ToString<bool>
+{
+	static void append(String& out, bool value) { out.append(value ? "true" : "false"); }
+};
+
+template<CharacterType T>
+struct ToString<T>
+{
+	static void append(String& out, T value) { out.push_back(CharType(value)); }
+};
+
 template<typename Target, typename Source>
 requires (LexicalCastTarget<Target> && LexicalCastSource<Source>)
 	  ||  std::is_same_v<Target, Source> // same type falls to specialization
 	  ||  UsesCustomCast<Target, Source>::value
+	  ||  (HasFromString<Target> && (std::is_same_v<Source, String> || std::is_same_v<Source, StringView>))
+	  ||  (HasToString<Source> && std::is_same_v<Target, String>)
 struct LexicalCast
 {
 	static Target cast(const Source& src)
@@ -67,38 +177,119 @@ struct LexicalCast
 		Target ret = Target();
 
 		if (!((ss << src) && (ss >> ret)))
-			throw BadLexicalCast<Target, Source>();
+			throw BadLexicalCast<Target, Source>(fmt::format("can't convert {} to {}", NameOfType<Source>, NameOfType<Target>));
 		return ret;
 	}
 };
 
-template<LexicalCastTarget Target>
-struct LexicalCast<Target, String>
+/** @brief Conversion from text, throws `BadLexicalCast<Target, StringView>` on invalid text. */
+template<typename Target>
+requires LexicalCastTarget<Target> || HasFromString<Target>
+struct LexicalCast<Target, StringView>
 {
-	static Target cast(const String& src)
+	static Target cast(StringView src)
 	{
-		Target ret = Target();
-		std::basic_istringstream<CharType> ss(src);
-		if (!(ss >> ret))
-			throw BadLexicalCast<Target, String>();
-		return ret;
+		if constexpr (HasFromString<Target>)
+			return FromString<Target>::parse(src);
+		else
+		{
+			Target ret = Target();
+			std::basic_istringstream<CharType> ss{ String(src) };
+			if (!(ss >> ret))
+				throw BadLexicalCast<Target, StringView>(fmt::format("\"{}\" is not a valid {}", src, NameOfType<Target>));
+			return ret;
+		}
 	}
 };
 
-template<LexicalCastSource Source>
+/** @brief Same as `LexicalCast<Target, StringView>`. */
+template<typename Target>
+requires LexicalCastTarget<Target> || HasFromString<Target>
+struct LexicalCast<Target, String>
+{
+	static Target cast(const String& src) { return LexicalCast<Target, StringView>::cast(src); }
+};
+
+template<typename Source>
+requires LexicalCastSource<Source> || HasToString<Source>
 struct LexicalCast<String, Source>
 {
 	static String cast(const Source& src)
 	{
-		std::basic_ostringstream<CharType> ss;
-		ss << src;
-		return ss.str();
+		if constexpr (HasToString<Source>)
+		{
+			String ret;
+			ToString<Source>::append(ret, src);
+			return ret;
+		}
+		else
+		{
+			std::basic_ostringstream<CharType> ss;
+			ss << src;
+			return ss.str();
+		}
 	}
 };
 
 template<typename T>
 struct LexicalCast<T, T> { static const T& cast(const T& src) { return src; } };
 
+template<>
+struct LexicalCast<String, String> { static const String& cast(const String& src) { return src; } };
+
+template<>
+struct LexicalCast<String, StringView> { static String cast(StringView src) { return String(src); } };
+
+/** @brief Set `target` from the text of an argument, strings are assigned as they are. */
+template<typename T>
+void assign_text(T& target, StringView text)
+{
+	if constexpr (std::is_same_v<T, String>)
+		target.assign(text);
+	else
+		target = LexicalCast<T, StringView>::cast(text);
+}
+
+/**
+ * @brief Append the values of `text` split at `delimiter` (not split if it's `'\0'`) to `values`.
+ * @details Storage grows once for all of them. Numbers are converted in a single pass with
+ *          `std::from_chars`, a number it doesn't take as a whole goes through `FromString`,
+ *          which throws if it's invalid.
+ * @throws `BadLexicalCast<T, StringView>` on an invalid value, `values` is left as it was
+**/
+template<typename T>
+void append_values(std::vector<T>& values, StringView text, CharType delimiter = '\0')
+{
+	std::size_t count = delimiter == '\0' ? 1 : std::size_t(std::count(text.begin(), text.end(), delimiter)) + 1;
+	std::size_t first = values.size();
+	values.resize(first + count);
+	T* value = values.data() + first;
+
+	const CharType* begin = text.data();
+	const CharType* last = begin + text.size();
+	try
+	{
+		for (std::size_t i = 0; i < count; i++, value++)
+		{
+			const CharType* end = i + 1 == count ? last : std::find(begin, last, delimiter);
+			if constexpr (NumberType<T>)
+			{
+				auto [stop, error] = std::from_chars(begin, end, *value);
+				if (error != std::errc() || stop != end)
+					*value = FromString<T>::parse(StringView(begin, end - begin));
+			}
+			else
+				assign_text(*value, StringView(begin, end - begin));
+			begin = end + 1;
+		}
+	}
+	catch (...)
+	{
+		values.resize(first);
+		throw;
+	}
+}
+
 
 NAMESPACE_END(detail) CLIPP_END
 
@@ -1,20 +1,334 @@
 #include "../include/CLI++/ArgumentParser.hpp"
 #include "../include/CLI++/detail.hpp"
+#include "../include/CLI++/detail/IO.hpp"
 
 CLIPP_BEGIN
 
 REGISTER_TYPENAME(String, "string");
 
-void ArgParser::parse(int argc, const char** argv)
+ArgParser::ArgParser() = default;
+ArgParser::~ArgParser()
 {
+	for (OptionBase* opt : options)
+		delete opt;
+	for (OptionBase* arg : positionals)
+		delete arg;
+	for (ArgParser* command : subcommands)
+		delete command;
+}
 
+void ArgParser::parse(int argc, const char** argv)
+{
+	parseArgs(std::size_t(argc), [argv](std::size_t i) { return StringView(argv[i]); });
 }
 
 void ArgParser::parse(const std::vector<String>& args)
 {
+	parseArgs(args.size(), [&args](std::size_t i) { return StringView(args[i]); });
+}
+
+void ArgParser::parse(std::span<const StringView> args)
+{
+	parseArgs(args.size(), [args](std::size_t i) { return args[i]; });
+}
+
+void ArgParser::buildIndex()
+{
+	short_index.fill(nullptr);
+	long_index.clear();
+	for (OptionBase* opt : options)
+	{
+		if (char c = opt->shortName(); c != '\0')
+		{
+			OptionBase*& slot = short_index[static_cast<unsigned char>(c)];
+			if (slot != nullptr)
+				throw CLIException(fmt::format("duplicate option -{}", c));
+			slot = opt;
+		}
+		for (const String& name : opt->longNames())
+		{
+			if (!long_index.emplace(name, opt).second)
+				throw CLIException(fmt::format("duplicate option --{}", name));
+		}
+	}
+	subcommand_index.clear();
+	for (ArgParser* command : subcommands)
+	{
+		if (!subcommand_index.emplace(command->command_name, command).second)
+			throw CLIException(fmt::format("duplicate subcommand {}", command->command_name));
+	}
+	index_built = true;
+}
+
+void ArgParser::validate() const
+{
+	for (OptionBase* opt : options)
+		opt->resolve();
+	for (OptionBase* arg : positionals)
+		arg->resolve();
+}
+
+void ArgParser::reset()
+{
+	for (OptionBase* opt : options)
+		opt->reset();
+	for (OptionBase* arg : positionals)
+		arg->reset();
+	for (ArgParser* command : subcommands)
+		command->reset();
+	selected = nullptr;
+}
+
+std::unique_ptr<ArgParser> ArgParser::clone() const
+{
+	auto copy = std::make_unique<ArgParser>();
+	copy->command_name = command_name;
+	copy->desc = desc;
+	copy->origin = this;
+	copy->eager = eager;
+	copy->response_files = response_files;
+	copy->extra_positionals = extra_positionals;
+	// room is reserved first, so the copy owns every clone as soon as it's made
+	copy->options.reserve(options.size());
+	for (OptionBase* opt : options)
+		copy->options.push_back(opt->clone());
+	copy->positionals.reserve(positionals.size());
+	for (OptionBase* arg : positionals)
+		copy->positionals.push_back(arg->clone());
+	copy->subcommands.reserve(subcommands.size());
+	for (ArgParser* command : subcommands)
+		copy->subcommands.push_back(command->clone().release());
+	return copy;
+}
+
+OptionBase* ArgParser::findCopy(const OptionBase* opt) const
+{
+	if (origin == nullptr)
+		return nullptr;
+	// options are cloned in order, the copy of one has its index
+	for (std::size_t i = 0; i < options.size(); i++)
+	{
+		if (origin->options[i] == opt)
+			return options[i];
+	}
+	for (std::size_t i = 0; i < positionals.size(); i++)
+	{
+		if (origin->positionals[i] == opt)
+			return positionals[i];
+	}
+	for (ArgParser* command : subcommands)
+	{
+		if (OptionBase* found = command->findCopy(opt))
+			return found;
+	}
+	return nullptr;
+}
+
+bool ArgParser::nextArg(StringView& arg)
+{
+	while (true)
+	{
+		if (file_tokens.has_value())
+		{
+			if (file_tokens->next(arg))
+				return true;
+			if (auto err = file_tokens->error(); err.type != detail::ArgvError::OK)
+				throw CLICommandParseError("response file {}: unbalanced quote {}", file_arg.substr(1), err.quote);
+			file_tokens.reset();
+		}
+		if (next_arg >= arg_count)
+			return false;
+		arg = arg_at(next_arg++);
+		if (!response_files || arg.size() < 2 || arg[0] != '@')
+			return true;
+		openResponseFile(arg);
+	}
+}
 
+void ArgParser::openResponseFile(StringView arg)
+{
+	try
+	{
+		auto& file = mapped_files.emplace_back(std::make_unique<detail::MappedFile>(String(arg.substr(1)), true));
+		file_tokens.emplace(file->text());
+	}
+	catch (const CLIException& e)
+	{
+		throw CLICommandParseError("can't read response file {}", e.what());
+	}
+	file_arg = arg;
 }
 
+bool ArgParser::nextExtra(StringView& arg)
+{
+	if (!extra_pending)
+		return input != nullptr && input->nextArg(arg);
+	extra_pending = false;
+	arg = extra_first;
+	return true;
+}
+
+ArgParser* ArgParser::addSubcommand(StringView name, StringView desc)
+{
+	auto* command = new ArgParser();
+	command->command_name = OptionBase::validateLongName(name);
+	command->desc = desc;
+	subcommands.push_back(command);
+	index_built = false;
+	return command;
+}
 
+void ArgParser::parseArgs(std::size_t count, ArgSource source)
+{
+	arg_at = std::move(source);
+	arg_count = count;
+	next_arg = 1;
+	file_tokens.reset();
+	mapped_files.clear();
+	program = count > 0 ? arg_at(0) : StringView();
+	parseFrom(*this);
+}
+
+void ArgParser::parseFrom(ArgParser& input)
+{
+	if (!index_built)
+		buildIndex();
+	// values of the last parse are dropped, converted or not, subcommands are reset when selected
+	for (OptionBase* opt : options)
+		opt->reset();
+	for (OptionBase* arg : positionals)
+		arg->reset();
+	this->input = &input;
+	selected = nullptr;
+	extra_pending = false;
+
+	// values are kept as they are, `OptionBase::resolve` converts them
+	auto set = [](OptionBase* opt, StringView text) {
+		if (opt->collects)
+			opt->collect(text);
+		else
+			opt->text = text;
+		opt->is_pending = true;
+		opt->is_given = true;
+	};
+	auto missing_value = [](const OptionBase* opt, StringView given) {
+		if (opt->arity() == 1)
+			return CLICommandParseError("option {} requires a value", given);
+		return CLICommandParseError("option {} requires {} values", given, opt->arity());
+	};
+	// an option taking several values takes the arguments following the first one
+	auto set_values = [&](OptionBase* opt, StringView first, StringView given) {
+		set(opt, first);
+		for (std::size_t i = 1; i < opt->arity(); i++)
+		{
+			StringView value;
+			if (!input.nextArg(value))
+				throw missing_value(opt, given);
+			set(opt, value);
+		}
+	};
+	auto set_flag = [](OptionBase* opt) {
+		opt->assign(StringView());
+		opt->is_given = true;
+	};
+	std::size_t next_positional = 0;
+	bool options_ended = false;
+	StringView arg;
+	while (input.nextArg(arg))
+	{
+		// a lone `-` is positional, it usually means stdin
+		if (options_ended || arg.size() < 2 || arg[0] != '-')
+		{
+			if (next_positional == positionals.size() && !subcommands.empty())
+			{
+				// the subcommand parses the rest, only parsers on the way are ever looked at
+				auto it = subcommand_index.find(arg);
+				if (it == subcommand_index.end())
+					throw CLICommandParseError("unknown command \"{}\"", arg);
+				selected = it->second;
+				selected->parseFrom(input);
+				break;
+			}
+			if (next_positional == positionals.size())
+			{
+				if (!extra_positionals)
+					throw CLICommandParseError("unexpected argument \"{}\"", arg);
+				// this one and the rest are read through `extraPositionals`
+				extra_first = arg;
+				extra_pending = true;
+				break;
+			}
+			OptionBase* positional = positionals[next_positional++];
+			set(positional, arg);
+			continue;
+		}
+
+		StringView value;
+		if (arg[1] == '-')
+		{
+			if (arg.size() == 2)
+			{
+				options_ended = true;
+				continue;
+			}
+			StringView name = arg.substr(2);
+			auto equal = name.find('=');
+			auto it = long_index.find(name.substr(0, equal));
+			if (it == long_index.end())
+				throw CLICommandParseError("unknown option \"--{}\"", name.substr(0, equal));
+			OptionBase* opt = it->second;
+			StringView given = arg.substr(0, 2 + it->first.size());
+
+			if (opt->type() == OptionType::Flag)
+			{
+				if (equal != StringView::npos)
+					throw CLICommandParseError("option {} doesn't take a value", given);
+				set_flag(opt);
+			}
+			else if (equal != StringView::npos)
+				set_values(opt, name.substr(equal + 1), given);
+			else if (input.nextArg(value))
+				set_values(opt, value, given);
+			else
+				throw missing_value(opt, given);
+			continue;
+		}
+
+		// bundled short options, the first one taking a value takes the rest of the argument
+		for (std::size_t j = 1; j < arg.size(); j++)
+		{
+			OptionBase* opt = short_index[static_cast<unsigned char>(arg[j])];
+			const CharType short_given[] = { '-', arg[j] };
+			StringView given(short_given, 2);
+			if (opt == nullptr)
+				throw CLICommandParseError("unknown option \"{}\"", given);
+			if (opt->type() == OptionType::Flag)
+			{
+				set_flag(opt);
+				continue;
+			}
+			if (j + 1 < arg.size())
+				set_values(opt, arg.substr(j + 1), given);
+			else if (input.nextArg(value))
+				set_values(opt, value, given);
+			else
+				throw missing_value(opt, given);
+			break;
+		}
+	}
+
+	for (OptionBase* opt : options)
+	{
+		if (opt->required() && !opt->given())
+			throw CLICommandParseError("missing required option --{}", opt->name());
+	}
+	for (OptionBase* arg : positionals)
+	{
+		if (arg->required() && !arg->given())
+			throw CLICommandParseError("missing required argument <{}>", arg->name());
+	}
+	if (eager)
+		validate();
+}
 
-CLIPP_END
\ No newline at end of file
+CLIPP_END
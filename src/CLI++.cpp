@@ -1,6 +1,20 @@
 #include "../include/CLI++/CLI++.hpp"
+#include "../include/CLI++/detail/Process.hpp"
+#include "../include/CLI++/detail/IO.hpp"
+#include "../include/CLI++/detail/ThreadPool.hpp"
 #include <iostream>
 #include <ranges>
+#include <optional>
+#include <atomic>
+#include <charconv>
+#include <deque>
+#include <utility>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <cmath>
+
+#include <sys/resource.h>
 
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -10,19 +24,76 @@ CLIPP_BEGIN
 static auto CMDAND  = detail::StringConstant<'&', '&'>;
 static auto CMDOR   = detail::StringConstant<'|', '|'>;
 static auto CMDPIPE = detail::StringConstant<'|'>;
+static auto CMDEXT  = detail::StringConstant<'!'>;
+static auto CMDIN   = detail::StringConstant<'<'>;
+static auto CMDOUT  = detail::StringConstant<'>'>;
+static auto CMDAPPEND = detail::StringConstant<'>', '>'>;
+static auto CMDBG   = detail::StringConstant<'&'>;
+static auto CMDFANOUT = detail::StringConstant<'|', '>'>;
+static auto CMDLPAREN = detail::StringConstant<'('>;
+static auto CMDRPAREN = detail::StringConstant<')'>;
+static auto CMDCOMMA  = detail::StringConstant<','>;
+static auto CMDTIME    = detail::StringConstant<'t', 'i', 'm', 'e'>;
+static auto CMDPROFILE = detail::StringConstant<'p', 'r', 'o', 'f', 'i', 'l', 'e'>;
+
+/** @brief Tokens like `!prog` or `!` start a stage that runs an external program. */
+static bool is_external_command(StringView token)
+{
+	return !token.empty() && token.front() == CMDEXT[0];
+}
+static bool is_redirection(StringView token)
+{
+	return (token == CMDIN) || (token == CMDOUT) || (token == CMDAPPEND);
+}
+/** @brief Parse a positive count, e.g. value of an option. */
+static bool parse_count(StringView value, std::size_t& count)
+{
+	auto [end, err] = std::from_chars(value.data(), value.data() + value.size(), count);
+	return err == std::errc() && end == value.data() + value.size() && count > 0;
+}
+/** @brief Collect arguments of a stage from tokens `[begin, end)`, redirections are left out. */
+template<typename TokenIter>
+static ArgList stage_args(TokenIter begin, TokenIter end, std::pmr::memory_resource* resource)
+{
+	ArgList args(resource);
+	args.reserve(std::distance(begin, end));
+	for (; begin != end; ++begin)
+	{
+		// `CLI::parse` makes sure every redirection is followed by a file name
+		if (is_redirection(*begin))
+			++begin;
+		else
+			args.emplace_back(*begin);
+	}
+	return args;
+}
+/** @brief Build argument vector of an external program from tokens `[begin, end)` of a stage. */
+template<typename TokenIter>
+static std::vector<String> external_argv(TokenIter begin, TokenIter end)
+{
+	ArgList args = stage_args(begin, end, CLI::lineResource());
+	std::vector<String> argv;
+	argv.reserve(args.size());
+	if (args.front().size() > 1)
+		argv.emplace_back(args.front().substr(1));
+	argv.insert(argv.end(), std::next(args.begin()), args.end());
+	return argv;
+}
 
 ///////////////// Readline API /////////////////
 char* command_generator(const char* text, int state)
 {
-	static std::size_t len = 0;
-	static CLI::CLICommandMap::iterator begin, end;
+	CLI* session = CLI::current_session;
+	if (session == nullptr)
+		return rl_filename_completion_function(text, state);
+	auto& [ begin, end, len ] = session->completion;
 
 	// if this is a new word to complete, initialize now.
 	// this includes saving the length of TEXT for efficiency, and initializing the iterator.
 	if (state == 0)
 	{
-		begin = CLI::cli_instance->commands.begin();
-		end   = CLI::cli_instance->commands.end();
+		begin = session->registry->begin();
+		end   = session->registry->end();
 		len = strlen(text);
 	}
 
@@ -47,6 +118,134 @@ char** command_completion(const char* text, int start, int end)
 }
 
 
+/**
+ * Bound to `Ctrl-R`: search history for the current line, pressing it again without editing
+ * the line shows the next older match.
+**/
+int history_search(int count, int key)
+{
+	CLI* session = CLI::current_session;
+	if (session == nullptr || !session->history_file)
+		return rl_reverse_search_history(count, key);
+
+	auto& state = session->history_search_state;
+	StringView line(rl_line_buffer, rl_end);
+	if (state.shown.empty() || line != state.shown)
+	{
+		state.query.assign(line);
+		state.last = History::npos;
+	}
+
+	History::EntryId id = state.last;
+	StringView found;
+	do
+	{
+		id = session->history_file->search(state.query, id);
+		if (id != History::npos)
+			found = session->history_file->entry(id);
+	} while (id != History::npos && found == line);	// skip a match equal to what's shown
+
+	if (id == History::npos)
+	{
+		rl_ding();
+		return 0;
+	}
+	state.last = id;
+	state.shown.assign(found);
+	rl_replace_line(state.shown.data(), 0);
+	rl_point = rl_end;
+	return 0;
+}
+
+
+/** @brief Number of columns `text` takes on a terminal, escape sequences take none. */
+static std::size_t display_width(StringView text)
+{
+	std::size_t width = 0;
+	for (std::size_t i = 0; i < text.size(); i++)
+	{
+		if (text[i] == '\x1b')
+		{
+			// CSI sequences end with a letter
+			while (i < text.size() && !std::isalpha(static_cast<unsigned char>(text[i])))
+				i++;
+		}
+		else if (text[i] == PROMPT_IGNORE_START[0] || text[i] == PROMPT_IGNORE_END[0])
+			continue;
+		else if ((static_cast<unsigned char>(text[i]) & 0xC0) != 0x80)	// skip UTF-8 continuation bytes
+			width++;
+	}
+	return width;
+}
+/** @brief Longest prefix of `text` taking at most `width` columns, characters aren't cut. */
+static StringView prefix_of_width(StringView text, std::size_t width)
+{
+	std::size_t end = 0;
+	for (std::size_t columns = 0; end < text.size(); columns++)
+	{
+		if (columns == width)
+			break;
+		// a character is its first byte followed by continuation bytes
+		end++;
+		while (end < text.size() && (static_cast<unsigned char>(text[end]) & 0xC0) == 0x80)
+			end++;
+	}
+	return text.substr(0, end);
+}
+
+/** @brief Redisplay hook: draw the suggestion for the line dimmed after the cursor. */
+void suggestion_redisplay()
+{
+	rl_redisplay();
+
+	CLI* session = CLI::current_session;
+	if (session == nullptr || !session->suggestions || rl_done)
+		return;
+
+	auto& state = session->suggestion_state;
+	StringView line(rl_line_buffer, rl_end);
+	if (line != state.line)
+	{
+		state.line.assign(line);
+		state.text = session->suggestion(line);
+	}
+	// whatever was drawn after the line before is stale
+	std::fputs("\x1b[K", rl_outstream);
+	if (rl_point == rl_end && !state.text.empty())
+	{
+		// the cursor is moved back afterwards, which doesn't work across lines
+		int rows = 0, cols = 0;
+		rl_get_screen_size(&rows, &cols);
+		std::size_t column = (display_width(rl_display_prompt ? rl_display_prompt : "") + display_width(line)) % std::max(cols, 1);
+		std::size_t room = cols > 0 ? std::size_t(cols) - 1 - column : 0;
+		StringView ghost = prefix_of_width(state.text, room);
+		if (!ghost.empty())
+		{
+			// the cursor moves by columns, which isn't the size of a ghost that isn't ASCII
+			fmt::print(rl_outstream, "\x1b[2m{}\x1b[0m\x1b[{}D", ghost, display_width(ghost));
+		}
+	}
+	std::fflush(rl_outstream);
+}
+/** @brief Bound to `Right` and `Ctrl-F`: accept the suggestion at the end of line, move forward otherwise. */
+int suggestion_accept(int count, int key)
+{
+	CLI* session = CLI::current_session;
+	if (session == nullptr || !session->suggestions || rl_point != rl_end
+		|| session->suggestion_state.text.empty() || StringView(rl_line_buffer, rl_end) != session->suggestion_state.line)
+		return rl_forward_char(count, key);
+	rl_insert_text(session->suggestion_state.text.data());
+	return 0;
+}
+/** @brief Bound to `Enter`: the suggestion must not stay on screen after the line. */
+int suggestion_newline(int count, int key)
+{
+	if (CLI* session = CLI::current_session; session != nullptr && session->suggestions)
+		std::fputs("\x1b[K", rl_outstream);
+	return rl_newline(count, key);
+}
+
+
 /////////////// Special Excepion ///////////////
 class CLIExceptionExit : public CLIException
 {
@@ -62,34 +261,40 @@ private:
 
 
 ////////////////// CLICommand //////////////////
-int CLICommand::pos = 0;
+thread_local int CLICommand::pos = 0;
 char* CLICommand::match(const char* text, int len) const
 {
 	if (pos == 0 && cmd.compare(0, len, text) == 0)
 		return detail::strdup(cmd.data());
 
+	std::vector<OptionType> schema_options, schema_subcmds;
+	if (schema)
+		schemaOptions(schema_options, schema_subcmds);
+	const auto& opts = schema ? schema_options : options;
+	const auto& subs = schema ? schema_subcmds : subcmds;
+
 	if (pos != 0 && len > 0)
 	{
 		// search sub commands first
 		auto subcmd_it = std::ranges::find_if(
-			subcmds,
+			subs,
 			[text, len](const OptionType& opt) {
 				return opt.name.compare(0, len, text) == 0;
 			}
 		);
-		if (subcmd_it != subcmds.cend())
+		if (subcmd_it != subs.cend())
 			return detail::strdup(subcmd_it->name.data());
 	}
 	if (pos != 0 && len >= 2 && std::strncmp(text, "--", 2) == 0)
 	{
 		// search for options
 		auto opt_it = std::ranges::find_if(
-			options,
+			opts,
 			[text, len](const OptionType& opt) {
 				return opt.name.compare(0, len - 2, text + 2) == 0;
 			}
 		);
-		if (opt_it != subcmds.cend())
+		if (opt_it != opts.cend())
 			return detail::strdup(String("--" + opt_it->name).data());
 	}
 
@@ -97,27 +302,46 @@ char* CLICommand::match(const char* text, int len) const
 }
 String CLICommand::usage() const
 {
+	std::vector<OptionType> schema_options, schema_subcmds;
+	if (schema)
+		schemaOptions(schema_options, schema_subcmds);
+	const auto& opts = schema ? schema_options : options;
+	const auto& subs = schema ? schema_subcmds : subcmds;
+
 	std::basic_ostringstream<CharType> ss;
-	if (subcmds.size() > 0)
+	if (subs.size() > 0)
 	{
 		ss << "sub commands:\n";
 		std::size_t max_len = std::ranges::max(
-			std::views::transform(subcmds,
+			std::views::transform(subs,
 			[](const OptionType& opt) { return opt.name.size(); }
 		));
-		for (auto& sub : subcmds)
+		for (auto& sub : subs)
 			ss << fmt::format("  {:<{}} {}\n", sub.name, max_len + 1, sub.desc);
 	}
 
-	if (options.size() > 0)
+	if (schema && !schema->parser.positionalList().empty())
+	{
+		auto positionals = schema->parser.positionalList();
+		std::size_t max_len = std::ranges::max(
+			std::views::transform(positionals,
+			[](const OptionBase* arg) { return arg->name().size() + 2; }
+		));
+
+		ss << "arguments:\n";
+		for (const OptionBase* arg : positionals)
+			ss << fmt::format("  {:<{}} {}\n", fmt::format("<{}>", arg->name()), max_len + 1, arg->description());
+	}
+
+	if (opts.size() > 0)
 	{
 		std::size_t max_len = std::ranges::max(
-			std::views::transform(options,
+			std::views::transform(opts,
 			[](const OptionType& opt) { return opt.name.size(); }
 		));
 
 		ss << "options:\n";
-		for (auto& opt : options)
+		for (auto& opt : opts)
 			ss << fmt::format("  {:3s} --{:<{}} {}\n"
 					, opt.short_name ? fmt::format("-{},", opt.short_name) : ""
 					, opt.name, max_len + 1
@@ -127,6 +351,24 @@ String CLICommand::usage() const
 	return ss.str();
 }
 
+ArgParser& CLICommand::arguments()
+{
+	if (!schema)
+		schema = std::make_unique<Schema>();
+	// copies made so far don't have what's about to be added
+	std::lock_guard lock(schema->lock);
+	schema->idle.clear();
+	schema->version++;
+	return schema->parser;
+}
+void CLICommand::schemaOptions(std::vector<OptionType>& opts, std::vector<OptionType>& subs) const
+{
+	for (const OptionBase* opt : schema->parser.optionList())
+		opts.push_back(OptionType{ opt->name(), opt->shortName(), opt->description() });
+	for (const ArgParser* sub : schema->parser.subcommandList())
+		subs.push_back(OptionType{ sub->commandName(), 0, sub->description() });
+}
+
 void CLICommand::addOption(const String& opt_name, char short_name, const String& desc)
 {
 	OptionType opt{ opt_name, short_name, desc };
@@ -190,7 +432,9 @@ Pipeline::Pipeline(std_iostream* buffer1, std_iostream* buffer2)
 	: buffer1{ buffer1 == nullptr ? new std_stringstream : buffer1, buffer1 != nullptr }
 	, buffer2{ buffer2 == nullptr ? new std_stringstream : buffer2, buffer2 != nullptr }
 	, working{ nullptr, &get_stdin_stream<CharType>() }
-	, is_opened(false) {}
+	, redirect{ nullptr, nullptr }
+	, terminal{ nullptr, nullptr }
+	, is_opened(false), written_count(0) {}
 
 Pipeline::~Pipeline()
 {
@@ -206,28 +450,49 @@ void Pipeline::clearAll()
 	buffer2.clear();
 }
 
-Pipeline::std_ostream& Pipeline::write(const String& str)
+Pipeline::std_ostream& Pipeline::write(StringView str)
 {
 	if (working.out == nullptr)
 		throw CLIException("trying to write to a closed pipe");
-	return (*working.out) << str;
+	detail::AllocationPhaseScope phase(AllocationPhase::PipelineIO);
+	written_count += str.size();
+	return working.out->write(str.data(), std::streamsize(str.size()));
+}
+std::streamoff Pipeline::inputPosition() const
+{
+	if (working.in == nullptr || working.in->rdbuf() == nullptr)
+		return -1;
+	return working.in->rdbuf()->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
 }
 
 void Pipeline::open()
 {
+	detail::AllocationPhaseScope phase(AllocationPhase::PipelineIO);
 	clearAll();
 	working.out = buffer2.stream;
-	working.in = &get_stdin_stream<CharType>();
+	if (redirect.in != nullptr)
+		working.in = redirect.in;
+	else if (terminal.in != nullptr)
+		working.in = terminal.in;
+	else
+		working.in = &get_stdin_stream<CharType>();
 	is_opened = true;
 }
 void Pipeline::close()
 {
-	working.out = nullptr;
+	working.out = redirect.out != nullptr ? redirect.out : terminal.out;
 	// note that we don't set working.in to default, because at this point,
 	// the pipe is only half closed: working.out reaches the end (means it needs to be stdout now),
 	// but working.in still holds the data from last command output, which may be needed.
 	is_opened = false;
 }
+void Pipeline::reset()
+{
+	redirect.in = nullptr;
+	redirect.out = nullptr;
+	this->close();
+	working.in = terminal.in != nullptr ? terminal.in : &get_stdin_stream<CharType>();
+}
 void Pipeline::swapWorkingInput()
 {
 	if (!this->opened())
@@ -238,11 +503,31 @@ void Pipeline::swapWorkingInput()
 	else
 		working.in = buffer2.stream;
 }
+int Pipeline::runExternal(const std::vector<std::vector<String>>& chain, detail::ProcessGroup* group)
+{
+	detail::ProcessIO io;
+	io.group = group;
+	// if the working input is stdin, let children read it directly
+	if (working.in != &get_stdin_stream<CharType>())
+		io.in = working.in;
+
+	auto file = working.out ? dynamic_cast<detail::FileOutputBuf*>(working.out->rdbuf()) : nullptr;
+	if (file != nullptr)
+	{
+		// output is redirected to a file, let the last program write to it directly
+		working.out->flush();
+		io.out_fd = file->fd();
+	}
+	else
+		io.out = working.out;
+	return detail::run_process_chain(chain, io);
+}
 void Pipeline::swapWorkingOutput()
 {
 	if (!this->opened())
 		return;
 
+	detail::AllocationPhaseScope phase(AllocationPhase::PipelineIO);
 	if (working.out != buffer1.stream)
 	{
 		buffer1.clear();
@@ -255,41 +540,509 @@ void Pipeline::swapWorkingOutput()
 	}
 }
 
-//////////////////    CLI     //////////////////
-CLI* CLI::cli_instance = nullptr;
-void CLI::init(char completion_key)
+//////////////////   Tracing   //////////////////
+#if CLIPP_ENABLE_TRACING
+thread_local CLI::TraceCursor CLI::trace_cursor;
+
+class CLI::TraceSpan
+{
+public:
+	TraceSpan(const CLI& cli, TraceEvent::Kind kind, StringView name)
+		: cli(cli), event{ kind, TraceEvent::Phase::Begin, 0, trace_cursor.pipeline, trace_cursor.stage, name, 0 }
+	{
+		emit();
+	}
+	TraceSpan(const TraceSpan&) = delete;
+	~TraceSpan()
+	{
+		// a step that hasn't ended is left by an exception
+		if (!ended)
+			event.return_code = 1;
+		event.phase = TraceEvent::Phase::End;
+		emit();
+	}
+
+	void end(int return_code)
+	{
+		event.return_code = return_code;
+		ended = true;
+	}
+private:
+	void emit()
+	{
+		if (cli.trace_hooks.empty())
+			return;
+		auto now = std::chrono::steady_clock::now().time_since_epoch();
+		event.timestamp = std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count());
+		for (auto& hook : cli.trace_hooks)
+			hook(cli, event);
+	}
+
+	const CLI& cli;
+	TraceEvent event;
+	bool ended = false;
+};
+
+#define CLIPP_TRACE_SPAN(span, kind, name) TraceSpan span(*this, TraceEvent::Kind::kind, name)
+#define CLIPP_TRACE_END(span, code)        span.end(code)
+#define CLIPP_TRACE_PIPELINE(index)        (trace_cursor = TraceCursor{ index, 0 })
+#define CLIPP_TRACE_STAGE(index)           (trace_cursor.stage = index)
+#define CLIPP_TRACE_NEXT_STAGE()           (++trace_cursor.stage)
+// steps run inside a step (e.g. fan-out branches) restore where the outer one is
+#define CLIPP_TRACE_NESTED()               ScopeGuard restore_trace_cursor{[saved = trace_cursor]() { trace_cursor = saved; }}
+#else
+#define CLIPP_TRACE_SPAN(span, kind, name) ((void)0)
+#define CLIPP_TRACE_END(span, code)        ((void)0)
+#define CLIPP_TRACE_PIPELINE(index)        ((void)0)
+#define CLIPP_TRACE_STAGE(index)           ((void)0)
+#define CLIPP_TRACE_NEXT_STAGE()           ((void)0)
+#define CLIPP_TRACE_NESTED()               ((void)0)
+#endif
+
+////////////////// Background Job //////////////////
+struct CLI::Job
+{
+	enum class State { Queued, Running, Done };
+
+	std::size_t id = 0;
+	String command_line;
+	// a job outlives the line it's started by, so it keeps its tokens in memory of its own
+	std::pmr::monotonic_buffer_resource arena;
+	TokenList tokens{ &arena };
+	PipelineList ranges{ &arena };
+
+	Pipeline::std_stringstream output;
+	detail::ViewInputStream input;	// jobs never read from the terminal
+	Pipeline pipeline;
+	detail::ProcessGroup processes;
+
+	std::atomic<bool> stop_requested = false;
+	// members below are guarded by `CLI::jobs_mutex`
+	State state = State::Queued;
+	int return_code = 0;
+	bool reported = false;
+	std::condition_variable finished;
+
+	Job() { pipeline.setTerminal(&input, &output); }
+};
+
+thread_local CLI::ExecContext* CLI::exec_context = nullptr;
+thread_local std::vector<CLI::StageTiming>* CLI::stage_timings = nullptr;
+thread_local std::pmr::memory_resource* CLI::line_resource = nullptr;
+thread_local ArgParser* CLI::call_arguments = nullptr;
+
+void CLI::submitJob(const String& command_line)
 {
-	if (cli_instance != nullptr)
-		throw CLIException("CLI can ONLY have one instance.");
-	cli_instance = this;
+	auto job = std::make_shared<Job>();
+	job->command_line = command_line;
+	job->tokens = detail::split_token(command_line, &job->arena);
+	job->tokens.pop_back();	// `&`
+	// syntax errors are reported right away, not when the job runs
+	{
+		CLIPP_TRACE_SPAN(span, Parse, command_line);
+		job->ranges = parse(job->tokens);
+		CLIPP_TRACE_END(span, 0);
+	}
 
-	rl_bind_key(completion_key, rl_complete);
-	rl_attempted_completion_function = command_completion;
+	{
+		std::lock_guard lock(jobs_mutex);
+		if (job_table.empty())
+			next_job_id = 1;
+		job->id = next_job_id++;
+		job_table.emplace(job->id, job);
+
+		if (!job_pool)
+			job_pool = std::make_unique<detail::ThreadPool>(std::max(4u, std::thread::hardware_concurrency()));
+		job_pool->submit([this, job]() { this->runJob(*job); });
+	}
+	print("[{}]\n", job->id);
+}
+
+void CLI::runJob(Job& job)
+{
+	{
+		std::lock_guard lock(jobs_mutex);
+		job.state = Job::State::Running;
+	}
 
-	commands.emplace("help", new CLICommandGeneric("help", [](CLI& cli, const ArgList& args) {
+	ExecContext context{ this, &job.pipeline, &job };
+	exec_context = &context;
+	line_resource = &job.arena;
+	int ret_code = 128 + SIGTERM;	// killed before it even started
+	try
+	{
+		if (!job.stop_requested)
+			ret_code = execute(job.ranges);
+	}
+	catch(const CLIExceptionExit& exit) { ret_code = exit.code(); }
+	catch(const std::exception& e)
+	{
+		job.output << "Error: " << e.what() << '\n';
+		ret_code = 1;
+	}
+	exec_context = nullptr;
+	line_resource = nullptr;
+
+	{
+		std::lock_guard lock(jobs_mutex);
+		job.return_code = ret_code;
+		job.state = Job::State::Done;
+	}
+	job.finished.notify_all();
+}
+
+void CLI::notifyJobs()
+{
+	std::lock_guard lock(jobs_mutex);
+	for (auto& [id, job] : job_table)
+	{
+		if (job->state != Job::State::Done || job->reported)
+			continue;
+		job->reported = true;
+		fmt::print("[{}] Done({}) {}\n", id, job->return_code, job->command_line);
+	}
+}
+
+static std::uint64_t thread_cpu_ns()
+{
+	timespec ts;
+	if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+		return 0;
+	return std::uint64_t(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+/** @brief User and system CPU time of this process and its child processes that have been waited for. */
+static std::uint64_t process_cpu_ns(std::uint64_t* user_ns = nullptr, std::uint64_t* system_ns = nullptr)
+{
+	auto ns = [](const timeval& tv) { return std::uint64_t(tv.tv_sec) * 1000000000 + std::uint64_t(tv.tv_usec) * 1000; };
+	rusage self{}, children{};
+	::getrusage(RUSAGE_SELF, &self);
+	::getrusage(RUSAGE_CHILDREN, &children);
+	std::uint64_t user = ns(self.ru_utime) + ns(children.ru_utime);
+	std::uint64_t system = ns(self.ru_stime) + ns(children.ru_stime);
+	if (user_ns != nullptr)
+		*user_ns = user;
+	if (system_ns != nullptr)
+		*system_ns = system;
+	return user + system;
+}
+
+int CLI::invoke(const CLICommand& command, const ArgList& args, Pipeline& pipeline)
+{
+	CLIPP_TRACE_SPAN(span, Command, command.name());
+	// keep a reference, `stats` may replace the metrics while running
+	std::shared_ptr<Metrics> metrics = command_metrics;
+	if (!metrics)
+	{
+		int ret_code = callCached(command, args, pipeline);
+		CLIPP_TRACE_END(span, ret_code);
+		return ret_code;
+	}
+
+	auto in_before = pipeline.inputPosition();
+	auto out_before = pipeline.written();
+	auto cpu_before = thread_cpu_ns();
+	auto wall_before = std::chrono::steady_clock::now();
+
+	int ret_code = 0;
+	auto record = [&]() {
+		auto wall = std::chrono::steady_clock::now() - wall_before;
+		auto in_after = pipeline.inputPosition();
+		metrics->record(command.name(), Metrics::Sample{
+			ret_code,
+			std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count()),
+			thread_cpu_ns() - cpu_before,
+			(in_before >= 0 && in_after > in_before) ? std::uint64_t(in_after - in_before) : 0,
+			pipeline.written() - out_before,
+		});
+	};
+	try
+	{
+		ret_code = callCached(command, args, pipeline);
+	}
+	catch (...)
+	{
+		// a command that throws failed, shells report such a failure as `1`
+		ret_code = 1;
+		record();
+		throw;
+	}
+	record();
+	CLIPP_TRACE_END(span, ret_code);
+	return ret_code;
+}
+
+int CLI::callCached(const CLICommand& command, const ArgList& args, Pipeline& pipeline)
+{
+	// typed arguments are parsed and converted once here, by a copy of the parser owned by this call
+	CLICommand::Schema* schema = command.schema.get();
+	std::unique_ptr<ArgParser> parser;
+	std::size_t version = 0;
+	if (schema)
+	{
+		std::lock_guard lock(schema->lock);
+		version = schema->version;
+		if (schema->idle.empty())
+			parser = schema->parser.clone();
+		else
+		{
+			parser = std::move(schema->idle.back());
+			schema->idle.pop_back();
+		}
+	}
+	ScopeGuard release_parser{[schema, &parser, version]() {
+		if (!parser)
+			return;
+		std::lock_guard lock(schema->lock);
+		if (schema->version != version)
+			return;
+		try { schema->idle.push_back(std::move(parser)); }
+		catch (...) {}	// the copy is just freed
+	}};
+	if (parser)
+	{
+		detail::AllocationPhaseScope phase(AllocationPhase::Parse);
+		try
+		{
+			parser->reset();
+			parser->parse(std::span<const StringView>(args));
+			parser->validate();
+		}
+		catch (const CLICommandParseError& e)
+		{
+			throw CLICommandParseError("{}: {}", command.name(), e.what());
+		}
+	}
+	ArgParser* outer_arguments = std::exchange(call_arguments, parser.get());
+	ScopeGuard restore_arguments{[outer_arguments]() { call_arguments = outer_arguments; }};
+
+	std::shared_ptr<OutputCache> cache = output_cache;
+	detail::AllocationPhaseScope phase(AllocationPhase::Command);
+	if (!cache || !command.pure())
+		return std::invoke(command, *this, args);
+
+	// input from stdin is not part of the key, any other input has to be hashed in place
+	Pipeline::std_istream& in = pipeline.get();
+	bool from_stdin = (&in == &get_stdin_stream<CharType>());
+	std::optional<StringView> input = from_stdin ? StringView() : detail::unread_view(in);
+	if (!input)
+		return std::invoke(command, *this, args);
+
+	auto emit = [&pipeline](const String& text) {
+		if (pipeline.writable())
+			pipeline.write(text);
+		else
+			fmt::print("{}", text);
+	};
+	// input is consumed as if the command had read it
+	auto consume = [&in, from_stdin]() {
+		if (!from_stdin)
+			in.seekg(0, std::ios_base::end);
+	};
+	if (auto entry = cache->find(args, *input))
+	{
+		consume();
+		emit(entry->output);
+		return entry->return_code;
+	}
+
+	// the command runs on a pipeline of its own, which captures its output
+	detail::ViewInputStream captured_in(*input);
+	Pipeline::std_stringstream captured_out;
+	Pipeline capture;
+	capture.setTerminal(&captured_in, &captured_out);
+	capture.reset();
+	int ret_code;
+	{
+		Job* job = (exec_context != nullptr && exec_context->owner == this) ? exec_context->job : nullptr;
+		ExecContext context{ this, &capture, job };
+		ExecContext* previous = std::exchange(exec_context, &context);
+		ScopeGuard restore{[previous]() { exec_context = previous; }};
+		ret_code = std::invoke(command, *this, args);
+	}
+	consume();
+
+	String output = std::move(captured_out).str();
+	emit(output);
+	// failures may be transient, only successful outputs are kept
+	if (ret_code == 0)
+		cache->insert(args, *input, OutputCache::Entry{ std::move(output), ret_code });
+	return ret_code;
+}
+
+String CLI::suggestion(StringView line) const
+{
+	if (!suggestions)
+		return String();
+	String text = suggestions->suggest(line);
+	// the model only knows words, the history may have the whole line
+	if (text.empty() && history_file)
+	{
+		if (auto entry = history_file->complete(line))
+			text = entry->substr(line.size());
+	}
+	return text;
+}
+
+Pipeline& CLI::activePipeline() const
+{
+	if (exec_context != nullptr && exec_context->owner == this)
+		return *exec_context->pipeline;
+	return pipeline;
+}
+
+bool CLI::stopRequested() const
+{
+	return exec_context != nullptr && exec_context->owner == this
+		&& exec_context->job != nullptr && exec_context->job->stop_requested;
+}
+
+////////////////  CommandRegistry  ////////////////
+CommandRegistry::CommandRegistry()
+{
+	// same as `insert`, `help` is kept in sync once all of them exist
+	auto add = [this](const char* name, auto&& f, const char* desc) {
+		CLICommand* cmd = ::new (pool.allocate()) CLICommandFunction(name, std::move(f), desc);
+		commands.emplace(cmd->name(), cmd);
+	};
+	add("help", [](CLI& cli, const ArgList& args) {
 		return cli.help(args);
-	}, "list all available commands or print help for specified command"));
-	commands.emplace("echo", new CLICommandGeneric("echo", [](CLI& cli, const ArgList& args) {
+	}, "list all available commands or print help for specified command");
+	add("echo", [](CLI& cli, const ArgList& args) {
 		return cli.echo(args);
-	}, "just an echo"));
-	commands.emplace("clear", new CLICommandGeneric("clear", [](CLI& cli, const ArgList&) {
+	}, "just an echo");
+	add("clear", [](CLI& cli, const ArgList&) {
 		return cli.clearScreen();
-	}, "clear screen"));
-	commands.emplace("exit", new CLICommandGeneric("exit", [](CLI& cli, const ArgList& args) {
+	}, "clear screen");
+	add("exit", [](CLI& cli, const ArgList& args) {
 		cli.exitImpl(args); return -1;
-	}, "exit cli with return code, if not specified, return 0"));
+	}, "exit cli with return code, if not specified, return 0");
+	add("jobs", [](CLI& cli, const ArgList& args) {
+		return cli.jobs(args);
+	}, "list background jobs started with a trailing \"&\"");
+	add("wait", [](CLI& cli, const ArgList& args) {
+		return cli.wait(args);
+	}, "wait for background jobs and print their output, wait for all jobs if none is specified");
+	add("kill", [](CLI& cli, const ArgList& args) {
+		return cli.kill(args);
+	}, "stop background jobs");
+	add("history", [](CLI& cli, const ArgList& args) {
+		return cli.history(args);
+	}, "print command history: history [-n COUNT] [PATTERN]");
+	add("stats", [](CLI& cli, const ArgList& args) {
+		return cli.stats(args);
+	}, "print metrics of commands: stats [-r] [-p FILE] [COMMAND...]");
+	// `time` and `profile` are prefixes handled by `CLI::parse`, they are commands only to be listed and completed
+	auto misplaced_prefix = [](CLI& cli, const ArgList& args) {
+		cli.printStderr("{}: can only be used at the start of a pipeline\n", args.front());
+		return 2;
+	};
+	add("time", +misplaced_prefix,
+		"print wall time, CPU time and peak memory of a pipeline and its stages: time <pipeline>");
+	add("profile", +misplaced_prefix,
+		"run a pipeline repeatedly and print percentiles of its timings: profile [-n RUNS] <pipeline>");
+	add("cache", [](CLI& cli, const ArgList& args) {
+		return cli.cache(args);
+	}, "print statistics of cached outputs of pure commands, or drop them: cache [-c] [COMMAND...]");
+	add("pmap", [](CLI& cli, const ArgList& args) {
+		return cli.pmap(args);
+	}, "run a command on each line of input in parallel: pmap [-j N] [-n LINES] [-k] <command> [args...]");
+
+	auto cmd_pmap = commands.at("pmap");
+	cmd_pmap->addOption("jobs", 'j', "number of worker threads, defaults to number of hardware threads");
+	cmd_pmap->addOption("lines", 'n', "number of lines passed to each invocation, defaults to 1");
+	cmd_pmap->addOption("keep-order", 'k', "write outputs in the order of input");
+
+	commands.at("history")->addOption("count", 'n', "number of entries printed, defaults to 20");
+	commands.at("profile")->addOption("runs", 'n', "number of runs, defaults to 10");
+	commands.at("cache")->addOption("clear", 'c', "drop cached outputs of the given commands, or all of them");
+
+	auto cmd_stats = commands.at("stats");
+	cmd_stats->addOption("reset", 'r', "reset metrics after printing or exporting them");
+	cmd_stats->addOption("prometheus", 'p', "export metrics to a file in Prometheus text format");
 
 	auto cmd_help = commands.at("help");
 	for (auto& [ cmd_name, cmd ] : commands)
 		cmd_help->addSubCommand(String(cmd_name), cmd->description());
-	// fmt::print("{}: {}\n{}\n", cmd_help->name(), cmd_help->description(), cmd_help->usage());
+}
+CommandRegistry::~CommandRegistry()
+{
+	for (auto& [name, cmd] : commands)
+	{
+		destroy(cmd);
+	}
 }
 
+void CommandRegistry::insert(CLICommand* command)
+{
+	if (auto it = commands.find(command->name()); it != commands.end())
+	{
+		CLICommand* old = it->second;
+		commands.erase(it);
+		this->updateHelp(old, true);
+		destroy(old);
+	}
+	commands.emplace(command->name(), command);
+	this->updateHelp(command);
+}
+CLICommand* CommandRegistry::take(StringView name)
+{
+	auto it = commands.find(name);
+	if (it == commands.end())
+		return nullptr;
+	CLICommand* ret = it->second;
+	commands.erase(it);
+	this->updateHelp(ret, true);
+	if (pool.owns(ret))
+	{
+		// the caller owns it from now on, it can't stay in the pool
+		auto* pooled = static_cast<CLICommandFunction*>(ret);
+		ret = new CLICommandFunction(std::move(*pooled));
+		destroy(pooled);
+	}
+	return ret;
+}
+void CommandRegistry::destroy(CLICommand* cmd)
+{
+	if (pool.owns(cmd))
+	{
+		cmd->~CLICommand();
+		pool.deallocate(cmd);
+	}
+	else
+		delete cmd;
+}
+void CommandRegistry::updateHelp(const CLICommand* cmd, bool removed)
+{
+	auto* cmd_help = this->find("help");
+	if (cmd_help == nullptr || cmd_help == cmd)
+		return;
+	if (removed)
+		cmd_help->removeSubCommand(cmd->name());
+	else
+		cmd_help->addSubCommand(cmd->name(), cmd->description());
+}
+
+//////////////////    CLI     //////////////////
+thread_local CLI* CLI::current_session = nullptr;
+
 CLI::CLI(const String& prompt, char completion_key, TokenSpliterFunction spliter)
-	: last_return_code(0), pipeline()
-	, in_exec_loop(false), prompt(prompt), token_spliter(spliter)
+	: CLI(std::make_shared<CommandRegistry>(), prompt, completion_key, spliter)
+{
+	// nobody else has seen the registry yet
+	editable_registry = const_cast<CommandRegistry*>(registry.get());
+}
+CLI::CLI(std::shared_ptr<const CommandRegistry> commands, const String& prompt, char completion_key, TokenSpliterFunction spliter)
+	: last_return_code(0), pipeline(), error_stream(nullptr)
+	, in_exec_loop(false), prompt(prompt), completion_key(completion_key), completion()
+	, registry(std::move(commands)), editable_registry(nullptr), token_spliter(spliter)
+	, line_buffer(new std::byte[LINE_BUFFER_SIZE]), line_arena(line_buffer.get(), LINE_BUFFER_SIZE)
+	, next_job_id(1)
 {
-	this->init(completion_key);
+	command_metrics = std::make_shared<Metrics>();
+	output_cache = std::make_shared<OutputCache>();
+	if (!registry)
+		throw CLIException("CLI needs a command registry.");
 }
 // CLI::CLI(Pipeline::std_iostream& stream, const String& prompt, char completion_key)
 // 	: in_exec_loop(false), prompt(prompt), last_return_code(0), pipeline(stream)
@@ -297,10 +1050,24 @@ CLI::CLI(const String& prompt, char completion_key, TokenSpliterFunction spliter
 
 CLI::~CLI()
 {
-	for (auto& [name, cmd] : commands)
 	{
-		delete cmd;
+		std::lock_guard lock(jobs_mutex);
+		for (auto& [id, job] : job_table)
+		{
+			job->stop_requested = true;
+			job->processes.kill();
+		}
 	}
+	// joins the workers, so no job is using commands any more
+	job_pool.reset();
+	pmap_pool.reset();
+}
+
+CommandRegistry& CLI::editableCommands()
+{
+	if (editable_registry == nullptr)
+		throw CLIException("Commands are shared with other sessions and can no longer be modified.");
+	return *editable_registry;
 }
 
 int CLI::exit(int code) const
@@ -332,7 +1099,7 @@ int CLI::echo(const ArgList& args) const
 }
 int CLI::help(const ArgList& args) const
 {
-	const auto& cmds = this->commands;
+	const auto& cmds = *registry;
 	if (args.size() < 2)
 	{
 		print("available commands:\n");
@@ -346,7 +1113,7 @@ int CLI::help(const ArgList& args) const
 		printStderr("help: Unkown command \"{}\"\n", cmd);
 		return 1;
 	}
-	auto pcmd = cmds.at(cmd);
+	auto pcmd = cmds.find(cmd);
 	print("{}: {}\n{}", cmd, pcmd->description(), pcmd->usage());
 	return 0;
 }
@@ -355,102 +1122,636 @@ int CLI::clearScreen() const
 	print("\x1b\x5b\x48\x1b\x5b\x32\x4a");
 	return 0;
 }
-void CLI::updateHelp(const CLICommand* cmd)
+int CLI::jobs(const ArgList&) const
 {
-	if (!commands.contains("help"))
-		return;
-	auto* cmd_help = commands.at("help");
-	cmd_help->addSubCommand(cmd->name(), cmd->description());
+	std::lock_guard lock(jobs_mutex);
+	for (auto& [id, job] : job_table)
+	{
+		switch (job->state)
+		{
+		case Job::State::Queued:
+			print("[{}] {:<10} {}\n", id, "Queued", job->command_line);
+			break;
+		case Job::State::Running:
+			print("[{}] {:<10} {}\n", id, job->stop_requested ? "Stopping" : "Running", job->command_line);
+			break;
+		case Job::State::Done:
+			print("[{}] {:<10} {}\n", id, fmt::format("Done({})", job->return_code), job->command_line);
+			break;
+		}
+	}
+	return 0;
+}
+/** @brief Find jobs by ids in `args[1...]`, all jobs if no id is given. */
+template<typename JobMap>
+static bool find_jobs(const CLI& cli, const JobMap& table, const ArgList& args,
+                      std::vector<typename JobMap::mapped_type>& found)
+{
+	if (args.size() < 2)
+	{
+		for (auto& [id, job] : table)
+			found.push_back(job);
+		return true;
+	}
+
+	bool all_found = true;
+	for (auto& arg : args | std::views::drop(1))
+	{
+		std::size_t id = 0;
+		auto [end, err] = std::from_chars(arg.data(), arg.data() + arg.size(), id);
+		if (err != std::errc() || end != arg.data() + arg.size() || !table.contains(id))
+		{
+			cli.printStderr("{}: no such job: {}\n", args[0], arg);
+			all_found = false;
+			continue;
+		}
+		found.push_back(table.at(id));
+	}
+	return all_found;
+}
+int CLI::wait(const ArgList& args)
+{
+	std::vector<std::shared_ptr<Job>> targets;
+	int ret_code = 0;
+	{
+		std::lock_guard lock(jobs_mutex);
+		if (!find_jobs(*this, job_table, args, targets))
+			ret_code = 127;
+	}
+
+	for (auto& job : targets)
+	{
+		// a background job can't wait for itself
+		if (exec_context != nullptr && exec_context->job == job.get())
+			continue;
+		{
+			std::unique_lock lock(jobs_mutex);
+			job->finished.wait(lock, [&job]() { return job->state == Job::State::Done; });
+			job_table.erase(job->id);
+		}
+		print("{}", job->output.view());
+		ret_code = job->return_code;
+	}
+	return ret_code;
+}
+int CLI::pmap(const ArgList& args)
+{
+	std::size_t threads = std::max(1u, std::thread::hardware_concurrency());
+	std::size_t lines = 1;
+	bool keep_order = false;
+
+	auto parse_option = [this](StringView opt, StringView value, std::size_t& count) {
+		if (!parse_count(value, count))
+		{
+			printStderr("pmap: invalid value for {}: \"{}\"\n", opt, value);
+			return false;
+		}
+		return true;
+	};
+
+	std::size_t pos = 1;
+	for (; pos < args.size() && args[pos].starts_with('-'); pos++)
+	{
+		StringView opt = args[pos];
+		if (opt == "-k" || opt == "--keep-order")
+			keep_order = true;
+		else if (opt == "-j" || opt == "--jobs" || opt == "-n" || opt == "--lines")
+		{
+			if (++pos == args.size())
+			{
+				printStderr("pmap: missing value for {}\n", opt);
+				return 2;
+			}
+			std::size_t& count = (opt == "-j" || opt == "--jobs") ? threads : lines;
+			if (!parse_option(opt, args[pos], count))
+				return 2;
+		}
+		else
+		{
+			printStderr("pmap: unknown option {}\n", opt);
+			return 2;
+		}
+	}
+	if (pos == args.size())
+	{
+		printStderr("pmap: usage: pmap [-j N] [-n LINES] [-k] <command> [args...]\n");
+		return 2;
+	}
+	const CLICommand* command = registry->find(args[pos]);
+	if (command == nullptr)
+	{
+		printStderr("pmap: unrecognized command: {}\n", args[pos]);
+		return 2;
+	}
+	ArgList command_args(args.begin() + pos, args.end(), lineResource());
+
+	// split input into pieces of `lines` lines, pieces refer to the input buffer
+	Pipeline& active = activePipeline();
+	String storage;
+	StringView input = detail::unread_view(active.get(), storage);
+	std::vector<StringView> pieces;
+	while (!input.empty())
+	{
+		std::size_t end = 0;
+		for (std::size_t n = 0; n < lines && end < input.size(); n++)
+		{
+			auto eol = input.find('\n', end);
+			end = (eol == StringView::npos) ? input.size() : eol + 1;
+		}
+		pieces.push_back(input.substr(0, end));
+		input.remove_prefix(end);
+	}
+
+	struct Worker
+	{
+		Pipeline pipeline;
+		Pipeline::std_stringstream output;
+	};
+	threads = std::min(threads, std::max<std::size_t>(pieces.size(), 1));
+	std::deque<Worker> workers(threads);
+
+	std::mutex output_mutex;
+	std::vector<String> outputs(keep_order ? pieces.size() : 0);
+	std::vector<bool> finished(keep_order ? pieces.size() : 0);
+	std::size_t next_output = 0;
+	std::atomic<int> ret_code = 0;
+
+	// workers can't use `print`, it would write to their own pipeline
+	auto emit = [&active](StringView text) {
+		if (active.writable())
+			active.write(String(text));
+		else
+			fmt::print("{}", text);
+	};
+
+	detail::ThreadPool* pool;
+	{
+		std::lock_guard lock(jobs_mutex);
+		if (!pmap_pool)
+			pmap_pool = std::make_unique<detail::ThreadPool>(std::max(4u, std::thread::hardware_concurrency()));
+		pool = pmap_pool.get();
+	}
+
+	Job* job = (exec_context != nullptr && exec_context->owner == this) ? exec_context->job : nullptr;
+	detail::parallel_for(*pool, pieces.size(), threads, [&](std::size_t id, std::size_t index) {
+		if (job != nullptr && job->stop_requested)
+			return;
+
+		Worker& worker = workers[id];
+		detail::ViewInputStream piece(pieces[index]);
+		worker.pipeline.setTerminal(&piece, &worker.output);
+		worker.pipeline.reset();
+
+		ExecContext context{ this, &worker.pipeline, job };
+		ExecContext* previous = std::exchange(exec_context, &context);
+		ScopeGuard restore{[previous]() { exec_context = previous; }};
+		CLIPP_TRACE_NESTED();
+		CLIPP_TRACE_PIPELINE(0);
+		CLIPP_TRACE_STAGE(index);
+		ret_code |= this->invoke(*command, command_args, worker.pipeline);
+
+		std::lock_guard lock(output_mutex);
+		if (!keep_order)
+			emit(worker.output.view());
+		else
+		{
+			outputs[index] = std::move(worker.output).str();
+			finished[index] = true;
+			// write every output that is no longer waiting for an earlier one
+			for (; next_output < outputs.size() && finished[next_output]; next_output++)
+			{
+				emit(outputs[next_output]);
+				String().swap(outputs[next_output]);
+			}
+		}
+		worker.output.str(String());
+	});
+	return ret_code;
+}
+int CLI::history(const ArgList& args) const
+{
+	if (!history_file)
+	{
+		printStderr("history: no history file is set\n");
+		return 1;
+	}
+	std::size_t count = 20;
+	StringView pattern;
+	for (std::size_t i = 1; i < args.size(); i++)
+	{
+		if ((args[i] == "-n" || args[i] == "--count") && i + 1 < args.size())
+		{
+			auto value = args[++i];
+			auto [end, err] = std::from_chars(value.data(), value.data() + value.size(), count);
+			if (err != std::errc() || end != value.data() + value.size())
+			{
+				printStderr("history: invalid count: \"{}\"\n", value);
+				return 2;
+			}
+		}
+		else
+			pattern = args[i];
+	}
+
+	// collect newest first, print oldest first like other shells
+	std::vector<std::pair<History::EntryId, StringView>> found;
+	for (auto id = history_file->search(pattern); id != History::npos && found.size() < count;
+		id = history_file->search(pattern, id))
+	{
+		found.emplace_back(id, history_file->entry(id));
+	}
+	for (auto it = found.rbegin(); it != found.rend(); ++it)
+		print("{:>6}  {}\n", it->first + 1, it->second);
+	return 0;
+}
+/** @brief Format nanoseconds with a unit that keeps the number short. */
+static String format_duration(std::uint64_t ns)
+{
+	if (ns < 10'000)
+		return fmt::format("{}ns", ns);
+	if (ns < 10'000'000)
+		return fmt::format("{:.1f}us", double(ns) / 1e3);
+	if (ns < 10'000'000'000)
+		return fmt::format("{:.1f}ms", double(ns) / 1e6);
+	return fmt::format("{:.1f}s", double(ns) / 1e9);
+}
+int CLI::stats(const ArgList& args)
+{
+	std::shared_ptr<Metrics> metrics = command_metrics;
+	if (!metrics)
+	{
+		printStderr("stats: metrics are not collected\n");
+		return 1;
+	}
+	bool reset = false;
+	StringView export_path;
+	std::vector<StringView> names;
+	for (std::size_t i = 1; i < args.size(); i++)
+	{
+		if (args[i] == "-r" || args[i] == "--reset")
+			reset = true;
+		else if ((args[i] == "-p" || args[i] == "--prometheus") && i + 1 < args.size())
+			export_path = args[++i];
+		else
+			names.push_back(args[i]);
+	}
+
+	if (!export_path.empty())
+		metrics->exportPrometheus(String(export_path));
+	else
+	{
+		print("{:<12} {:>8} {:>8} {:>9} {:>9} {:>9} {:>9} {:>10} {:>10}\n",
+			"command", "calls", "failed", "p50", "p99", "max", "cpu avg", "read", "written");
+		metrics->forEach([&](StringView name, const CommandMetrics& m) {
+			if (!names.empty() && std::ranges::find(names, name) == names.end())
+				return;
+			auto calls = m.invocations.load(std::memory_order_relaxed);
+			auto failed = calls - m.return_codes[0].load(std::memory_order_relaxed);
+			print("{:<12} {:>8} {:>8} {:>9} {:>9} {:>9} {:>9} {:>10} {:>10}\n", name, calls, failed,
+				format_duration(m.wall_time.percentile(0.5)), format_duration(m.wall_time.percentile(0.99)),
+				format_duration(m.wall_time.max()), format_duration(calls ? m.cpu_time.sum() / calls : 0),
+				m.bytes_read.load(std::memory_order_relaxed), m.bytes_written.load(std::memory_order_relaxed));
+		});
+	}
+	if (reset)
+		metrics->reset();
+	return 0;
+}
+int CLI::cache(const ArgList& args)
+{
+	std::shared_ptr<OutputCache> outputs = output_cache;
+	if (!outputs)
+	{
+		printStderr("cache: outputs are not cached\n");
+		return 1;
+	}
+	bool clear = false;
+	std::vector<StringView> names;
+	for (std::size_t i = 1; i < args.size(); i++)
+	{
+		if (args[i] == "-c" || args[i] == "--clear")
+			clear = true;
+		else if (args[i].starts_with('-'))
+		{
+			printStderr("cache: unknown option {}\n", args[i]);
+			return 2;
+		}
+		else
+			names.push_back(args[i]);
+	}
+
+	if (clear)
+	{
+		if (names.empty())
+			outputs->clear();
+		for (StringView name : names)
+			outputs->invalidate(name);
+		return 0;
+	}
+
+	std::vector<StringView> pure;
+	for (auto& [name, command] : *registry)
+	{
+		if (command->pure())
+			pure.push_back(name);
+	}
+	auto stats = outputs->statistics();
+	print("pure commands: {}\nentries: {}\nsize:    {}\nhits:    {}\nmisses:  {}\n",
+		fmt::join(pure, " "), stats.entries, stats.bytes, stats.hits, stats.misses);
+	return 0;
 }
+int CLI::kill(const ArgList& args)
+{
+	if (args.size() < 2)
+	{
+		printStderr("kill: usage: kill <job-id>...\n");
+		return 1;
+	}
 
+	std::vector<std::shared_ptr<Job>> targets;
+	std::lock_guard lock(jobs_mutex);
+	bool all_found = find_jobs(*this, job_table, args, targets);
+	for (auto& job : targets)
+	{
+		job->stop_requested = true;
+		job->processes.kill();
+	}
+	return all_found ? 0 : 1;
+}
 int CLI::exec()
 {
-	in_exec_loop = true;
+	// readline is only set up when it's actually used
+	if (!line_source)
+		line_source = std::make_unique<ReadlineSource>(completion_key);
+
+	// completion of readline is process wide, it completes commands of the session reading a line
+	CLI* previous_session = std::exchange(current_session, this);
+	ScopeGuard restore_session{[previous_session]() { current_session = previous_session; }};
+
+	// line sources only keep history in memory, give them what previous sessions left
+	if (history_file)
+	{
+		auto count = history_file->size();
+		for (auto id = count - std::min<History::EntryId>(count, 1000); id < count; id++)
+		{
+			if (StringView entry = history_file->entry(id); !entry.empty())
+				line_source->addHistory(String(entry));
+		}
+		// learning every entry of a large history would delay the first prompt
+		if (suggestions && suggestions->size() == 0)
+		{
+			for (auto id = count - std::min<History::EntryId>(count, 10000); id < count; id++)
+				suggestions->learn(history_file->entry(id));
+		}
+	}
+
+	String input;
 	while (true)
 	{
-		char* raw_input = readline(prompt.data());
-		if (!raw_input)
+		notifyJobs();
+		if (!line_source->readLine(prompt, input))
 			break;
-		String input(raw_input);
-		free(raw_input);
 
 		if (detail::is_empty_string(input))
 			continue;
 
-		add_history(input.data());
+		line_source->addHistory(input);
+		if (history_file)
+			history_file->add(input);
+		if (suggestions)
+			suggestions->learn(input);
+		if (!this->runLine(input))
+			return last_return_code;
+	}
+	return 0;
+}
 
-		/**
-		 * TODO:
-		 *   [DONE] Pipeline buffer
-		 *   [DONE] parse pipeline operator
-		 *   [DONE] other operators like "&&" and "||"
-		**/
-		try
+bool CLI::runLine(const String& input)
+{
+	if (detail::is_empty_string(input))
+		return true;
+
+	// `exit` only ends the session while a line is running
+	bool was_in_loop = std::exchange(in_exec_loop, true);
+	// temporary data of the line is allocated from the arena, it's released at once afterwards,
+	// unless the line is run by a command of another line which still uses the arena
+	std::pmr::memory_resource* previous_resource = std::exchange(line_resource, &line_arena);
+	// a nested line adds its allocations to those of the line running it
+	if (!was_in_loop)
+		line_allocations = AllocationStats();
+	AllocationStats* previous_stats = std::exchange(detail::allocation_stats, &line_allocations);
+	ScopeGuard restore{[this, was_in_loop, previous_resource, previous_stats]() {
+		in_exec_loop = was_in_loop;
+		line_resource = previous_resource;
+		detail::allocation_stats = previous_stats;
+		if (!was_in_loop)
+			line_arena.release();
+	}};
+	/**
+	 * TODO:
+	 *   [DONE] Pipeline buffer
+	 *   [DONE] parse pipeline operator
+	 *   [DONE] other operators like "&&" and "||"
+	**/
+	try
+	{
+		TokenList tokens(&line_arena);
 		{
-			TokenList tokens = detail::split_token(input);
-			last_return_code = execute(parse(tokens));
+			detail::AllocationPhaseScope phase(AllocationPhase::Tokenize);
+			tokens = detail::split_token(input, &line_arena);
 		}
-		catch(const CLIExceptionExit& exit) { return exit.code(); }
-		catch(const std::exception& e)
+		if (tokens.empty())
+			return true;
+		if (tokens.back() == CMDBG)
+		{
+			if (tokens.size() == 1)
+				throw CLICommandParseError("unexpected operator \"{}\"", CMDBG);
+			this->submitJob(input);
+			last_return_code = 0;
+		}
+		else
 		{
-			fmt::print("{} {}\n",
-				fmt::styled("Error:", fmt::fg(fmt::rgb(0xF14C4C)) | fmt::emphasis::bold),
-				e.what());
+			PipelineList ranges(&line_arena);
+			{
+				detail::AllocationPhaseScope phase(AllocationPhase::Parse);
+				CLIPP_TRACE_SPAN(span, Parse, input);
+				ranges = parse(tokens);
+				CLIPP_TRACE_END(span, 0);
+			}
+			detail::AllocationPhaseScope phase(AllocationPhase::Dispatch);
+			last_return_code = execute(ranges);
 		}
 	}
-	in_exec_loop = false;
-	return 0;
+	catch(const CLIExceptionExit& exit)
+	{
+		last_return_code = exit.code();
+		return false;
+	}
+	catch(const std::exception& e)
+	{
+		printStderr("{} {}\n",
+			fmt::styled("Error:", fmt::fg(fmt::rgb(0xF14C4C)) | fmt::emphasis::bold),
+			e.what());
+	}
+	return true;
 }
 
-std::vector<CLI::PipelineRange> CLI::parse(const CLI::TokenList& tokens)
+CLI::PipelineList CLI::parse(const CLI::TokenList& tokens)
 {
-	using TokenListConstIter = TokenList::const_iterator;
-	const TokenListConstIter end = tokens.cend();
-	std::vector<PipelineRange> cmds;
+	TokenList::const_iterator it = tokens.cbegin();
+	// pipelines are allocated along with the tokens, they live as long as each other
+	PipelineList cmds = parseList(it, tokens.cend(), false, tokens.get_allocator().resource());
+	return cmds;
+}
 
-	auto is_operator = [](const String& s) {
-		return (s == CMDAND) || (s == CMDOR) || (s == CMDPIPE);
+CLI::PipelineList CLI::parseList(TokenList::const_iterator& it, TokenList::const_iterator end, bool nested,
+	std::pmr::memory_resource* resource)
+{
+	PipelineList cmds(resource);
+
+	auto is_operator = [](const auto& s) {
+		return (s == CMDAND) || (s == CMDOR) || (s == CMDPIPE) || (s == CMDFANOUT) || is_redirection(s)
+			|| (s == CMDLPAREN) || (s == CMDRPAREN) || (s == CMDCOMMA);
 	};
 
-	for (TokenListConstIter start = tokens.cbegin(), it = start; it != end;)
+	using BranchList = decltype(PipelineRange::branches);
+	PipelineRange range{ .start = it, .end = end, .branches = BranchList(resource) };
+	bool stage_start = true;	// next token should be a command
+	bool first_stage = true;
+	bool fanned_out  = false;	// a fan-out group ends the pipeline
+	for (; it != end; ++it)
 	{
-		if (!commands.contains(*it))
-			throw CLICommandParseError("unrecognized command: {}", *it);
-		TokenListConstIter op = std::find_if(it, end, is_operator);
-		if (op != end && *op == CMDPIPE)
+		// `,` or `)` ends a branch of a fan-out group
+		if (nested && (*it == CMDCOMMA || *it == CMDRPAREN))
+			break;
+
+		// `time` and `profile` apply to the whole pipeline they start
+		if (stage_start && (*it == CMDTIME || *it == CMDPROFILE))
 		{
-			it = ++op;
-			if (it == end)
-				cmds.emplace_back(start, --op);
+			if (!first_stage || range.timing != PipelineRange::Timing::None)
+				throw CLICommandParseError("\"{}\" can only be used at the start of a pipeline", *it);
+			auto prefix = it;
+			range.timing = (*it == CMDTIME) ? PipelineRange::Timing::Time : PipelineRange::Timing::Profile;
+			if (*it == CMDPROFILE && std::next(it) != end && (*std::next(it) == "-n" || *std::next(it) == "--runs"))
+			{
+				auto opt = ++it;
+				if (++it == end || !parse_count(*it, range.runs))
+					throw CLICommandParseError("\"{}\" needs a positive number of runs after \"{}\"", *prefix, *opt);
+			}
+			if (std::next(it) == end)
+				throw CLICommandParseError("missing command after \"{}\"", *prefix);
+			range.start = std::next(it);
 			continue;
 		}
-		cmds.emplace_back(start, op);
-		if (op == end)
-			break;
 
-		start = it = ++op;
+		if (stage_start)
+		{
+			if (is_external_command(*it))
+			{
+				if (it->size() == 1 && (std::next(it) == end || is_operator(*std::next(it))))
+					throw CLICommandParseError("missing program name after \"{}\"", *it);
+			}
+			else if (is_operator(*it))
+				throw CLICommandParseError("unexpected operator \"{}\"", *it);
+			else if (!registry->contains(*it))
+				throw CLICommandParseError("unrecognized command: {}", *it);
+			stage_start = false;
+		}
+		else if (*it == CMDAND || *it == CMDOR)
+		{
+			range.end = it;
+			cmds.push_back(std::move(range));
+			range = PipelineRange{ .start = std::next(it), .end = end, .branches = BranchList(resource) };
+			stage_start = first_stage = true;
+			fanned_out = false;
+		}
+		else if (fanned_out)
+			throw CLICommandParseError("unexpected \"{}\" after a fan-out group", *it);
+		else if (*it == CMDBG)
+			throw CLICommandParseError("\"{}\" is only allowed at the end of a command line", *it);
+		else if (*it == CMDPIPE)
+		{
+			if (range.output != nullptr)
+				throw CLICommandParseError("output can only be redirected in the last command of a pipeline");
+			stage_start = true;
+			first_stage = false;
+		}
+		else if (*it == CMDFANOUT)
+		{
+			if (range.output != nullptr)
+				throw CLICommandParseError("output can only be redirected in the last command of a pipeline");
+			if (++it == end || *it != CMDLPAREN)
+				throw CLICommandParseError("expected \"{}\" after \"{}\"", CMDLPAREN, CMDFANOUT);
+			do
+			{
+				++it;
+				range.branches.push_back(parseList(it, end, true, resource));
+				if (it == end)
+					throw CLICommandParseError("missing \"{}\"", CMDRPAREN);
+			} while (*it == CMDCOMMA);
+			fanned_out = true;
+		}
+		else if (*it == CMDLPAREN || *it == CMDRPAREN || *it == CMDCOMMA)
+			throw CLICommandParseError("unexpected \"{}\"", *it);
+		else if (is_redirection(*it))
+		{
+			auto op = it++;
+			if (it == end || is_operator(*it))
+				throw CLICommandParseError("missing file name after \"{}\"", *op);
+
+			if (*op == CMDIN)
+			{
+				if (!first_stage)
+					throw CLICommandParseError("input can only be redirected in the first command of a pipeline");
+				if (range.input != nullptr)
+					throw CLICommandParseError("input of a pipeline is redirected more than once");
+				range.input = &*it;
+			}
+			else
+			{
+				if (range.output != nullptr)
+					throw CLICommandParseError("output of a pipeline is redirected more than once");
+				range.output = &*it;
+				range.append = (*op == CMDAPPEND);
+			}
+		}
 	}
 
 	// makesure `&&` or `||` or `|` is not at the end
-	if (cmds.back().end != end)
-		throw CLICommandParseError("unexpected operator \"{}\" at the end", *cmds.back().end);
+	if (stage_start)
+	{
+		if (it == end)
+			throw CLICommandParseError("unexpected operator \"{}\" at the end", *std::prev(it));
+		throw CLICommandParseError("unexpected \"{}\"", *it);
+	}
+	range.end = it;
+	cmds.push_back(std::move(range));
 	return cmds;
 }
 
-int CLI::execute(const std::vector<CLI::PipelineRange>& cmd_list)
+int CLI::execute(const CLI::PipelineList& cmd_list)
 {
-	std::vector<PipelineRange>::const_iterator ths = cmd_list.cbegin();
-	std::vector<PipelineRange>::const_iterator end = cmd_list.cend();
-	int ret_code = runPipeline(*ths);
+	CLIPP_TRACE_NESTED();
+	auto run = [this, &cmd_list](PipelineList::const_iterator pipe) {
+		CLIPP_TRACE_PIPELINE(std::size_t(pipe - cmd_list.cbegin()));
+		CLIPP_TRACE_SPAN(span, Pipeline, *pipe->start);
+		int ret_code = (pipe->timing == PipelineRange::Timing::None) ? runPipeline(*pipe) : timePipeline(*pipe);
+		CLIPP_TRACE_END(span, ret_code);
+		return ret_code;
+	};
+
+	PipelineList::const_iterator ths = cmd_list.cbegin();
+	PipelineList::const_iterator end = cmd_list.cend();
+	int ret_code = run(ths);
 
 	for (auto lst = ths++; ths != end; ++ths)
 	{
-		const String& op_token = *lst->end;
+		StringView op_token = *lst->end;
 
 		if (op_token == CMDAND)
-			ret_code = !(ret_code == 0 && runPipeline(*ths) == 0); // reverse the result because `0` is what means OK
+			ret_code = !(ret_code == 0 && run(ths) == 0); // reverse the result because `0` is what means OK
 		else if (op_token == CMDOR)
-			ret_code = !(ret_code == 0 || runPipeline(*ths) == 0); // ditto
+			ret_code = !(ret_code == 0 || run(ths) == 0); // ditto
 		else
 			throw CLICommandParseError("unexpected operator \"{}\"", op_token);
 		lst = ths;
@@ -461,7 +1762,19 @@ int CLI::execute(const std::vector<CLI::PipelineRange>& cmd_list)
 
 int CLI::runPipeline(const CLI::PipelineRange& _pipe)
 {
-	ScopeGuard guard{[this]() { pipeline.close(); }};
+	std::optional<detail::MappedInputStream> input;
+	std::optional<detail::FileOutputStream> output;
+	Pipeline& active = activePipeline();
+	ScopeGuard guard{[&active]() { active.reset(); }};
+	if (_pipe.input != nullptr || _pipe.output != nullptr)
+	{
+		detail::AllocationPhaseScope phase(AllocationPhase::PipelineIO);
+		if (_pipe.input != nullptr)
+			active.redirectInput(&input.emplace(String(*_pipe.input)));
+		if (_pipe.output != nullptr)
+			active.redirectOutput(&output.emplace(String(*_pipe.output), _pipe.append));
+	}
+
 	/**
 	 * pipeline procedure should be something like this:
 	 * stdin > (pipe) > buffer1 > (pipe) > buffer2 > (pipe) > buffer1 > (pipe) > buffer2 > (pipe) > stdout
@@ -469,27 +1782,248 @@ int CLI::runPipeline(const CLI::PipelineRange& _pipe)
 	 *    in            out  in            out  in            out  in            out  in            out
 	 * buffer1 and buffer2 are used in turns
 	**/
-	pipeline.open();
+	// only stages of this pipeline are timed, not those of pipelines it runs (e.g. fan-out branches)
+	std::vector<StageTiming>* timings = std::exchange(stage_timings, nullptr);
+	ScopeGuard restore_timings{[timings]() { stage_timings = timings; }};
+	auto timed = [timings](auto begin, auto end, auto&& run) {
+		if (timings == nullptr)
+			return run();
+		auto wall_before = std::chrono::steady_clock::now();
+		auto cpu_before = process_cpu_ns();
+		int ret_code = run();
+		auto wall = std::chrono::steady_clock::now() - wall_before;
+		timings->push_back(StageTiming{
+			fmt::format("{}", fmt::join(begin, end, " ")),
+			std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count()),
+			process_cpu_ns() - cpu_before,
+			ret_code,
+		});
+		return ret_code;
+	};
+
+	active.open();
 	int ret_code = 0;
-	for (auto cmd_begin = _pipe.start; cmd_begin != _pipe.end;)
+	CLIPP_TRACE_STAGE(0);
+	// stages in front of `|>` produce the input shared by all branches
+	auto stages_end = _pipe.branches.empty() ? _pipe.end : std::find(_pipe.start, _pipe.end, CMDFANOUT);
+	for (auto cmd_begin = _pipe.start; cmd_begin != stages_end;)
 	{
-		auto cmd_end = std::find(cmd_begin, _pipe.end, CMDPIPE);
-		if (cmd_end != _pipe.end)
-			pipeline.swapWorkingOutput();
+		auto cmd_end = std::find(cmd_begin, stages_end, CMDPIPE);
+
+		// consecutive external programs are connected to each other directly,
+		// so they are collected and run as a single stage
+		std::vector<std::vector<String>> processes;
+		auto stage_begin = cmd_begin;
+		while (is_external_command(*cmd_begin))
+		{
+			processes.push_back(external_argv(cmd_begin, cmd_end));
+			if (cmd_end == stages_end || !is_external_command(*std::next(cmd_end)))
+				break;
+			cmd_begin = std::next(cmd_end);
+			cmd_end = std::find(cmd_begin, stages_end, CMDPIPE);
+		}
+
+		if (cmd_end != stages_end || !_pipe.branches.empty())
+			active.swapWorkingOutput();
 		else
-			pipeline.close();
+			active.close();
 
-		const CLICommand* command = commands.at(*cmd_begin);
-		ret_code |= std::invoke(*command, *this, ArgList(cmd_begin, cmd_end));
+		if (processes.empty())
+		{
+			const CLICommand* command = registry->find(*cmd_begin);
+			ret_code |= timed(cmd_begin, cmd_end, [&]() {
+				return this->invoke(*command, stage_args(cmd_begin, cmd_end, lineResource()), active);
+			});
+		}
+		else
+		{
+			detail::ProcessGroup* group = nullptr;
+			if (exec_context != nullptr && exec_context->owner == this && exec_context->job != nullptr)
+				group = &exec_context->job->processes;
+			CLIPP_TRACE_SPAN(span, Command, *stage_begin);
+			int external_code = timed(stage_begin, cmd_end, [&]() { return active.runExternal(processes, group); });
+			CLIPP_TRACE_END(span, external_code);
+			ret_code |= external_code;
+		}
 
-		pipeline.swapWorkingInput();
+		active.swapWorkingInput();
+		CLIPP_TRACE_NEXT_STAGE();
 
-		if (cmd_end == _pipe.end)
+		if (cmd_end == stages_end)
 			break;
 		cmd_begin = ++cmd_end;
 	}
 
+	if (!_pipe.branches.empty())
+		ret_code |= timed(stages_end, _pipe.end, [&]() { return runBranches(_pipe.branches, active); });
+
+	if (output && !output->flush())
+		throw CLIException(fmt::format("{}: write error", *_pipe.output));
+	return ret_code;
+}
+
+int CLI::timePipeline(const PipelineRange& pipe)
+{
+	bool profile = (pipe.timing == PipelineRange::Timing::Profile);
+	std::size_t runs = profile ? pipe.runs : 1;
+	// output of repeated runs would flood the terminal, it's discarded unless redirected
+	std::optional<detail::FileOutputStream> discard;
+	if (profile && pipe.output == nullptr)
+		discard.emplace("/dev/null", true);
+
+	struct Run
+	{
+		std::uint64_t wall;
+		std::uint64_t user;
+		std::uint64_t system;
+		std::vector<StageTiming> stages;
+	};
+	std::vector<Run> measured;
+	measured.reserve(runs);
+	std::vector<StageTiming> timings;
+	std::vector<StageTiming>* previous = std::exchange(stage_timings, &timings);
+	ScopeGuard restore{[previous]() { stage_timings = previous; }};
+
+	rusage usage{};
+	::getrusage(RUSAGE_SELF, &usage);
+	long rss_before = usage.ru_maxrss;
+
+	int ret_code = 0;
+	for (std::size_t i = 0; i < runs && !stopRequested(); i++)
+	{
+		if (discard)
+			activePipeline().redirectOutput(&*discard);
+		std::uint64_t user_before, system_before, user_after, system_after;
+		process_cpu_ns(&user_before, &system_before);
+		auto wall_before = std::chrono::steady_clock::now();
+		ret_code = runPipeline(pipe);
+		auto wall = std::chrono::steady_clock::now() - wall_before;
+		process_cpu_ns(&user_after, &system_after);
+		measured.push_back(Run{
+			std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(wall).count()),
+			user_after - user_before,
+			system_after - system_before,
+			std::exchange(timings, {}),
+		});
+	}
+	if (measured.empty())
+		return ret_code;
+
+	::getrusage(RUSAGE_SELF, &usage);
+	String rss = fmt::format("+{} KiB (peak {} KiB)", usage.ru_maxrss - rss_before, usage.ru_maxrss);
+	std::size_t name_width = 5;
+	for (auto& stage : measured.front().stages)
+		name_width = std::clamp(stage.name.size(), name_width, std::size_t(40));
+
+	if (!profile)
+	{
+		const Run& run = measured.front();
+		printStderr("real  {}\nuser  {}\nsys   {}\nrss   {}\n", format_duration(run.wall),
+			format_duration(run.user), format_duration(run.system), rss);
+		printStderr("{:<{}}  {:>9}  {:>9}  {:>4}\n", "stage", name_width, "wall", "cpu", "code");
+		for (auto& stage : run.stages)
+		{
+			printStderr("{:<{}}  {:>9}  {:>9}  {:>4}\n", stage.name, name_width,
+				format_duration(stage.wall_ns), format_duration(stage.cpu_ns), stage.return_code);
+		}
+		return ret_code;
+	}
+
+	// nearest rank percentiles of a few samples, they are sorted in place
+	auto percentiles = [](std::vector<std::uint64_t>& values) {
+		std::sort(values.begin(), values.end());
+		auto at = [&values](double q) {
+			std::size_t rank = std::size_t(std::ceil(q * double(values.size())));
+			return format_duration(values[std::clamp<std::size_t>(rank, 1, values.size()) - 1]);
+		};
+		std::uint64_t sum = 0;
+		for (auto value : values)
+			sum += value;
+		return fmt::format("{:>9}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}", format_duration(values.front()),
+			at(0.5), at(0.9), at(0.99), format_duration(values.back()), format_duration(sum / values.size()));
+	};
+	auto column = [&measured](auto value) {
+		std::vector<std::uint64_t> values;
+		values.reserve(measured.size());
+		for (auto& run : measured)
+			values.push_back(value(run));
+		return values;
+	};
+	auto wall = column([](const Run& run) { return run.wall; });
+	auto user = column([](const Run& run) { return run.user; });
+	auto system = column([](const Run& run) { return run.system; });
+
+	printStderr("{} runs, rss {}\n", measured.size(), rss);
+	printStderr("{:<{}}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}  {:>9}\n", "", name_width, "min", "p50", "p90", "p99", "max", "mean");
+	printStderr("{:<{}}  {}\n", "real", name_width, percentiles(wall));
+	printStderr("{:<{}}  {}\n", "user", name_width, percentiles(user));
+	printStderr("{:<{}}  {}\n", "sys", name_width, percentiles(system));
+	// a run that failed part way may have run fewer stages
+	for (std::size_t i = 0; i < measured.front().stages.size(); i++)
+	{
+		std::vector<std::uint64_t> stage_wall;
+		for (auto& run : measured)
+		{
+			if (i < run.stages.size())
+				stage_wall.push_back(run.stages[i].wall_ns);
+		}
+		printStderr("{:<{}}  {}\n", measured.front().stages[i].name, name_width, percentiles(stage_wall));
+	}
+	return ret_code;
+}
+
+int CLI::runBranches(const std::pmr::vector<PipelineList>& branches, Pipeline& active)
+{
+	// output of the producer is read by every branch in place
+	String storage;
+	StringView produced = detail::unread_view(active.get(), storage);
+	active.close();
+
+	struct Branch
+	{
+		detail::ViewInputStream input;
+		Pipeline::std_stringstream output;
+		Pipeline pipeline;
+		int ret_code = 0;
+		std::exception_ptr error;
+
+		explicit Branch(StringView produced) : input(produced) { pipeline.setTerminal(&input, &output); }
+	};
+	std::deque<Branch> states;
+	for (std::size_t i = 0; i < branches.size(); i++)
+		states.emplace_back(produced);
+
+	Job* job = (exec_context != nullptr && exec_context->owner == this) ? exec_context->job : nullptr;
+	auto run = [this, job](Branch& branch, const PipelineList& ranges) {
+		// the arena of the line isn't thread safe, every branch has memory of its own
+		std::byte buffer[4096];
+		std::pmr::monotonic_buffer_resource arena(buffer, sizeof(buffer));
+		ExecContext context{ this, &branch.pipeline, job };
+		ExecContext* previous = std::exchange(exec_context, &context);
+		std::pmr::memory_resource* previous_resource = std::exchange(line_resource, &arena);
+		try { branch.ret_code = execute(ranges); }
+		catch(...) { branch.error = std::current_exception(); }
+		exec_context = previous;
+		line_resource = previous_resource;
+	};
+	{
+		std::vector<std::jthread> threads;
+		threads.reserve(branches.size() - 1);
+		for (std::size_t i = 0; i + 1 < branches.size(); i++)
+			threads.emplace_back(run, std::ref(states[i]), std::cref(branches[i]));
+		run(states.back(), branches.back());
+	}
+
+	// outputs are written in the order of branches, so they never interleave
+	int ret_code = 0;
+	for (auto& branch : states)
+	{
+		if (branch.error)
+			std::rethrow_exception(branch.error);
+		print("{}", branch.output.view());
+		ret_code |= branch.ret_code;
+	}
 	return ret_code;
 }
 
-CLIPP_END
\ No newline at end of file
+CLIPP_END
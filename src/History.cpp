@@ -0,0 +1,245 @@
+#include "../include/CLI++/History.hpp"
+#include "../include/CLI++/detail/IO.hpp"
+#include "../include/CLI++/Exceptions.hpp"
+
+#include <algorithm>
+#include <span>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+CLIPP_BEGIN
+
+/**
+ * Key of the trigram starting at `p`. Only the low 6 bits of each character are kept, so the
+ * table of every key fits in cache while building the index. Trigrams folded onto the same key
+ * only add candidates, matches are always verified.
+**/
+static constexpr std::uint32_t TRIGRAM_KEYS = 1u << 18;
+static std::uint32_t trigram(const CharType* p)
+{
+	return ((std::uint32_t(p[0]) & 63) << 12) | ((std::uint32_t(p[1]) & 63) << 6) | (std::uint32_t(p[2]) & 63);
+}
+
+History::History(const String& path)
+	: file(-1), bulk_indexed(0), indexed(0)
+{
+	file = ::open(path.data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+	if (file < 0)
+		throw CLIException(fmt::format("{}: {}", path, std::strerror(errno)));
+	try
+	{
+		mapping = std::make_unique<detail::MappedFile>(path);
+	}
+	catch (...)
+	{
+		::close(file);
+		throw;
+	}
+
+	StringView contents = mapping->view();
+	// a rough guess, rehashing a large table is what makes loading slow
+	entries.reserve(contents.size() / 32);
+	latest.reserve(contents.size() / 32);
+	// an unterminated last line was cut off by a crash, it's dropped
+	while (!contents.empty())
+	{
+		auto eol = contents.find('\n');
+		if (eol == StringView::npos)
+			break;
+		if (eol != 0)
+			insert(contents.substr(0, eol));
+		contents.remove_prefix(eol + 1);
+	}
+}
+History::~History()
+{
+	::close(file);
+}
+
+void History::insert(StringView line)
+{
+	EntryId id = EntryId(entries.size());
+	auto [it, inserted] = latest.try_emplace(line, id);
+	if (!inserted)
+	{
+		entries[it->second] = StringView();
+		it->second = id;
+	}
+	entries.push_back(line);
+}
+
+void History::add(StringView line)
+{
+	if (line.empty() || line.find('\n') != StringView::npos)
+		return;
+
+	std::lock_guard lock(mutex);
+	if (auto it = latest.find(line); it != latest.end() && it->second + 1 == entries.size())
+		return;	// same as the last entry
+
+	String& stored = appended.emplace_back(line);
+	stored.push_back('\n');
+	// `O_APPEND` keeps lines of different processes sharing the file intact
+	for (StringView pending = stored; !pending.empty();)
+	{
+		ssize_t n = ::write(file, pending.data(), pending.size());
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;	// history is a convenience, failing to save it must not break the CLI
+		pending.remove_prefix(n);
+	}
+	insert(StringView(stored.data(), stored.size() - 1));
+}
+
+History::EntryId History::size() const
+{
+	std::lock_guard lock(mutex);
+	return EntryId(entries.size());
+}
+StringView History::entry(EntryId id) const
+{
+	std::lock_guard lock(mutex);
+	return id < entries.size() ? entries[id] : StringView();
+}
+
+void History::rebuildIndex() const
+{
+	// counting sort on trigram keys: count, then place ids in ascending order, so every
+	// posting list comes out sorted without sorting any of them
+	std::vector<std::uint32_t> offsets(TRIGRAM_KEYS + 1, 0);
+	// last entry each key has been seen in, an id is recorded once per key
+	std::vector<EntryId> seen(TRIGRAM_KEYS, npos);
+	auto for_each_key = [&](EntryId id, auto&& fn) {
+		StringView line = entries[id];
+		for (std::size_t i = 0; i + 3 <= line.size(); i++)
+		{
+			auto key = trigram(line.data() + i);
+			if (seen[key] != id)
+			{
+				seen[key] = id;
+				fn(key);
+			}
+		}
+	};
+
+	for (EntryId id = 0; id < entries.size(); id++)
+		for_each_key(id, [&](std::uint32_t key) { offsets[key + 1]++; });
+	for (std::size_t i = 1; i < offsets.size(); i++)
+		offsets[i] += offsets[i - 1];
+
+	index_ids.resize(offsets.back());
+	std::vector<std::uint32_t> next(offsets.begin(), offsets.end() - 1);
+	std::fill(seen.begin(), seen.end(), npos);
+	for (EntryId id = 0; id < entries.size(); id++)
+		for_each_key(id, [&](std::uint32_t key) { index_ids[next[key]++] = id; });
+
+	// keep only trigrams that occur
+	index_keys.clear();
+	index_offsets.clear();
+	for (std::uint32_t key = 0; key < TRIGRAM_KEYS; key++)
+	{
+		if (offsets[key + 1] == offsets[key])
+			continue;
+		index_keys.push_back(key);
+		index_offsets.push_back(offsets[key]);
+	}
+	index_offsets.push_back(offsets.back());
+
+	bulk_indexed = indexed = EntryId(entries.size());
+	recent_trigrams.clear();
+}
+
+void History::updateIndex() const
+{
+	if (indexed == entries.size())
+		return;
+	// merging is a full rebuild, do it only when it pays off
+	if (entries.size() - bulk_indexed > bulk_indexed / 4 + 4096)
+	{
+		rebuildIndex();
+		return;
+	}
+	for (; indexed < entries.size(); indexed++)
+	{
+		StringView line = entries[indexed];
+		for (std::size_t i = 0; i + 3 <= line.size(); i++)
+		{
+			auto& ids = recent_trigrams[trigram(line.data() + i)];
+			if (ids.empty() || ids.back() != indexed)
+				ids.push_back(indexed);
+		}
+	}
+}
+
+History::EntryId History::search(StringView needle, EntryId before) const
+{
+	std::lock_guard lock(mutex);
+	before = std::min<EntryId>(before, EntryId(entries.size()));
+	auto matches = [&](EntryId id) {
+		return !entries[id].empty() && entries[id].find(needle) != StringView::npos;
+	};
+
+	if (needle.size() < 3)
+	{
+		// too short for the index, recent entries match such needles quickly anyway
+		for (EntryId id = before; id-- > 0;)
+			if (matches(id))
+				return id;
+		return npos;
+	}
+
+	updateIndex();
+	// every trigram of `needle` must occur, candidates come from the rarest one
+	std::span<const EntryId> rarest;
+	std::span<const EntryId> rarest_recent;
+	bool first = true;
+	for (std::size_t i = 0; i + 3 <= needle.size(); i++)
+	{
+		auto key = trigram(needle.data() + i);
+		std::span<const EntryId> ids, recent_ids;
+		if (auto it = std::lower_bound(index_keys.begin(), index_keys.end(), key);
+			it != index_keys.end() && *it == key)
+		{
+			auto pos = it - index_keys.begin();
+			ids = std::span<const EntryId>(index_ids.data() + index_offsets[pos], index_ids.data() + index_offsets[pos + 1]);
+		}
+		if (auto it = recent_trigrams.find(key); it != recent_trigrams.end())
+			recent_ids = it->second;
+		if (ids.empty() && recent_ids.empty())
+			return npos;
+		if (first || ids.size() + recent_ids.size() < rarest.size() + rarest_recent.size())
+		{
+			rarest = ids;
+			rarest_recent = recent_ids;
+			first = false;
+		}
+	}
+	// recent ids are all larger than the others, search them first
+	for (auto candidates : { rarest_recent, rarest })
+	{
+		auto end = std::lower_bound(candidates.begin(), candidates.end(), before);
+		for (auto it = std::make_reverse_iterator(end); it != candidates.rend(); ++it)
+			if (matches(*it))
+				return *it;
+	}
+	return npos;
+}
+
+std::optional<StringView> History::complete(StringView prefix) const
+{
+	if (prefix.empty())
+		return std::nullopt;
+	for (EntryId id = search(prefix); id != npos; id = search(prefix, id))
+	{
+		StringView line = entry(id);
+		if (line.size() > prefix.size() && line.starts_with(prefix))
+			return line;
+	}
+	return std::nullopt;
+}
+
+CLIPP_END
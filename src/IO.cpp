@@ -0,0 +1,245 @@
+#include "../include/CLI++/detail/IO.hpp"
+#include "../include/CLI++/Exceptions.hpp"
+
+#include <sstream>
+#include <iterator>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+CLIPP_BEGIN NAMESPACE_BEGIN(detail)
+
+static CLIException make_io_error(const String& path)
+{
+	return CLIException(fmt::format("{}: {}", path, std::strerror(errno)));
+}
+
+//////////////// ViewStreamBuf  ////////////////
+ViewStreamBuf::ViewStreamBuf(StringView view)
+{
+	// characters are never written through `ViewStreamBuf`, casting away const is fine
+	CharType* begin = const_cast<CharType*>(view.data());
+	this->setg(begin, begin, begin + view.size());
+}
+
+std::streamsize ViewStreamBuf::showmanyc()
+{
+	std::streamsize n = egptr() - gptr();
+	return n > 0 ? n : -1;
+}
+
+ViewStreamBuf::pos_type ViewStreamBuf::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+{
+	if (!(which & std::ios_base::in))
+		return pos_type(off_type(-1));
+
+	CharType* base = nullptr;
+	switch (dir)
+	{
+	case std::ios_base::beg: base = eback(); break;
+	case std::ios_base::cur: base = gptr();  break;
+	case std::ios_base::end: base = egptr(); break;
+	default: return pos_type(off_type(-1));
+	}
+	if (off < eback() - base || off > egptr() - base)
+		return pos_type(off_type(-1));
+
+	this->setg(eback(), base + off, egptr());
+	return pos_type(gptr() - eback());
+}
+ViewStreamBuf::pos_type ViewStreamBuf::seekpos(pos_type pos, std::ios_base::openmode which)
+{
+	return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+
+std::optional<StringView> unread_view(std::basic_istream<CharType>& in)
+{
+	auto buf = in.rdbuf();
+	if (auto string_buf = dynamic_cast<std::basic_stringbuf<CharType>*>(buf))
+	{
+		StringView view = string_buf->view();
+		auto pos = string_buf->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+		view.remove_prefix(pos < 0 ? view.size() : std::min<std::size_t>(pos, view.size()));
+		return view;
+	}
+	if (auto view_buf = dynamic_cast<ViewStreamBuf*>(buf))
+		return view_buf->remaining();
+	return std::nullopt;
+}
+StringView unread_view(std::basic_istream<CharType>& in, String& storage)
+{
+	if (auto view = unread_view(in))
+		return *view;
+
+	storage.assign(std::istreambuf_iterator<CharType>(in), std::istreambuf_iterator<CharType>());
+	return storage;
+}
+
+
+//////////////////  MappedFile  //////////////////
+MappedFile::MappedFile(const String& path, bool private_copy)
+	: data(nullptr), size(0), mapped(0)
+{
+	int fd = ::open(path.data(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		throw make_io_error(path);
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0)
+	{
+		auto err = make_io_error(path);
+		::close(fd);
+		throw err;
+	}
+	if (!S_ISREG(st.st_mode))
+	{
+		::close(fd);
+		throw CLIException(fmt::format("{}: not a regular file", path));
+	}
+	size = st.st_size;
+	void* addr = nullptr;
+	if (private_copy)
+	{
+		// zeroed anonymous pages with the file mapped over them, the page after a file that fills
+		// its last page is one of them, so the NUL is always there without copying anything
+		mapped = size + sizeof(CharType);
+		addr = ::mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (addr != MAP_FAILED && size > 0
+			&& ::mmap(addr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+		{
+			auto err = make_io_error(path);
+			::munmap(addr, mapped);
+			::close(fd);
+			throw err;
+		}
+	}
+	else if (size > 0)
+	{
+		mapped = size;
+		addr = ::mmap(nullptr, mapped, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	if (addr == MAP_FAILED)
+	{
+		auto err = make_io_error(path);
+		::close(fd);
+		throw err;
+	}
+	if (size > 0)
+		::madvise(addr, size, MADV_SEQUENTIAL);
+	data = static_cast<CharType*>(addr);
+	// the mapping stays valid after the descriptor is closed
+	::close(fd);
+}
+MappedFile::~MappedFile()
+{
+	if (data != nullptr)
+		::munmap(data, mapped);
+}
+
+
+/////////////////  FileOutputBuf /////////////////
+FileOutputBuf::FileOutputBuf(int fd, bool owns_fd, std::size_t buffer_size)
+	: file(fd), owns_fd(owns_fd)
+	, buffer(new char_type[buffer_size]), capacity(buffer_size)
+{
+	this->setp(buffer, buffer + capacity);
+}
+FileOutputBuf::~FileOutputBuf()
+{
+	this->sync();
+	delete[] buffer;
+	if (owns_fd)
+		::close(file);
+}
+
+bool FileOutputBuf::flush(const char_type* s, std::size_t n)
+{
+	iovec iov[2] = {
+		{ pbase(), std::size_t(pptr() - pbase()) * sizeof(char_type) },
+		{ const_cast<char_type*>(s), n * sizeof(char_type) }
+	};
+	iovec* pending = iov;
+	int count = 2;
+	while (count > 0)
+	{
+		if (pending->iov_len == 0)
+		{
+			pending++, count--;
+			continue;
+		}
+		ssize_t written = ::writev(file, pending, count);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		// skip what has been written, writes may be partial
+		while (count > 0 && std::size_t(written) >= pending->iov_len)
+		{
+			written -= pending->iov_len;
+			pending++, count--;
+		}
+		if (count > 0)
+		{
+			pending->iov_base = static_cast<char*>(pending->iov_base) + written;
+			pending->iov_len -= written;
+		}
+	}
+	this->setp(buffer, buffer + capacity);
+	return true;
+}
+
+FileOutputBuf::int_type FileOutputBuf::overflow(int_type ch)
+{
+	if (!flush(nullptr, 0))
+		return traits_type::eof();
+	if (!traits_type::eq_int_type(ch, traits_type::eof()))
+	{
+		*pptr() = traits_type::to_char_type(ch);
+		this->pbump(1);
+	}
+	return traits_type::not_eof(ch);
+}
+
+std::streamsize FileOutputBuf::xsputn(const char_type* s, std::streamsize n)
+{
+	if (n <= epptr() - pptr())
+	{
+		traits_type::copy(pptr(), s, n);
+		this->pbump(int(n));
+		return n;
+	}
+	// doesn't fit, write the buffer and the new chunk together
+	return flush(s, n) ? n : 0;
+}
+
+int FileOutputBuf::sync()
+{
+	return flush(nullptr, 0) ? 0 : -1;
+}
+
+
+//////////////// FileOutputStream ////////////////
+static int open_output_file(const String& path, bool append)
+{
+	int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+	int fd = ::open(path.data(), flags, 0644);
+	if (fd < 0)
+		throw make_io_error(path);
+	return fd;
+}
+
+FileOutputStream::FileOutputStream(const String& path, bool append)
+	: std::basic_ostream<CharType>(nullptr), buf(open_output_file(path, append), true)
+{
+	this->init(&buf);
+}
+
+NAMESPACE_END(detail) CLIPP_END
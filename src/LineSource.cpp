@@ -0,0 +1,156 @@
+#include "../include/CLI++/LineSource.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+
+#include <fmt/format.h>
+
+#include <unistd.h>
+
+#include <readline/readline.h>
+#include <readline/history.h>
+
+CLIPP_BEGIN
+
+// defined along with the other Readline callbacks in CLI++.cpp
+char** command_completion(const char* text, int start, int end);
+int    history_search(int count, int key);
+void   suggestion_redisplay();
+int    suggestion_accept(int count, int key);
+int    suggestion_newline(int count, int key);
+
+//////////////// ReadlineSource ////////////////
+ReadlineSource::ReadlineSource(char completion_key)
+{
+	rl_bind_key(completion_key, rl_complete);
+	rl_attempted_completion_function = command_completion;
+	rl_bind_keyseq("\\C-r", history_search);
+	// suggestions fall back to the usual behavior when a session has none
+	rl_redisplay_function = suggestion_redisplay;
+	rl_bind_keyseq("\\e[C", suggestion_accept);
+	rl_bind_keyseq("\\eOC", suggestion_accept);
+	rl_bind_keyseq("\\C-f", suggestion_accept);
+	rl_bind_key('\n', suggestion_newline);
+	rl_bind_key('\r', suggestion_newline);
+}
+
+bool ReadlineSource::readLine(const String& prompt, String& line)
+{
+	char* raw_input = readline(prompt.data());
+	if (!raw_input)
+		return false;
+	line.assign(raw_input);
+	free(raw_input);
+	return true;
+}
+void ReadlineSource::addHistory(const String& line)
+{
+	add_history(line.data());
+}
+
+///////////////// FdLineSource /////////////////
+FdLineSource::FdLineSource(int fd, bool owns_fd, bool show_prompt, std::size_t buffer_size)
+	: file(fd), owns_fd(owns_fd), show_prompt(show_prompt)
+	, buffer(new CharType[buffer_size]), capacity(buffer_size), begin(0), end(0)
+{}
+FdLineSource::~FdLineSource()
+{
+	if (owns_fd)
+		::close(file);
+}
+
+bool FdLineSource::fill()
+{
+	// keep the unfinished line, move it to the front to make room
+	if (begin > 0)
+	{
+		std::memmove(buffer.get(), buffer.get() + begin, (end - begin) * sizeof(CharType));
+		end -= begin;
+		begin = 0;
+	}
+	if (end == capacity)
+	{
+		auto larger = std::make_unique<CharType[]>(capacity * 2);
+		std::memcpy(larger.get(), buffer.get(), end * sizeof(CharType));
+		buffer = std::move(larger);
+		capacity *= 2;
+	}
+	while (true)
+	{
+		ssize_t n = ::read(file, buffer.get() + end, (capacity - end) * sizeof(CharType));
+		if (n > 0)
+		{
+			end += n / sizeof(CharType);
+			return true;
+		}
+		if (n < 0 && errno == EINTR)
+			continue;
+		return false;
+	}
+}
+
+bool FdLineSource::readLine(const String& prompt, String& line)
+{
+	if (show_prompt)
+	{
+		fmt::print("{}", prompt);
+		std::fflush(stdout);
+	}
+
+	std::size_t searched = begin;
+	while (true)
+	{
+		auto* data = buffer.get();
+		if (auto* eol = static_cast<CharType*>(std::memchr(data + searched, '\n', end - searched)))
+		{
+			line.assign(data + begin, eol);
+			begin = eol - data + 1;
+			return true;
+		}
+		searched = end - begin;
+		if (!fill())
+			break;
+	}
+	if (begin == end)
+		return false;
+	line.assign(buffer.get() + begin, buffer.get() + end);
+	begin = end;
+	return true;
+}
+
+//////////////// StdinLineSource ////////////////
+StdinLineSource::StdinLineSource()
+	: FdLineSource(STDIN_FILENO, false, ::isatty(STDIN_FILENO))
+{}
+
+//////////////// QueueLineSource ////////////////
+bool QueueLineSource::readLine(const String&, String& line)
+{
+	std::unique_lock lock(mutex);
+	available.wait(lock, [this]() { return closed || !lines.empty(); });
+	if (lines.empty())
+		return false;
+	line = std::move(lines.front());
+	lines.pop_front();
+	return true;
+}
+
+void QueueLineSource::push(String line)
+{
+	{
+		std::lock_guard lock(mutex);
+		lines.push_back(std::move(line));
+	}
+	available.notify_one();
+}
+void QueueLineSource::close()
+{
+	{
+		std::lock_guard lock(mutex);
+		closed = true;
+	}
+	available.notify_all();
+}
+
+CLIPP_END
@@ -0,0 +1,198 @@
+#include "../include/CLI++/Metrics.hpp"
+#include "../include/CLI++/Exceptions.hpp"
+
+#include <bit>
+#include <mutex>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+CLIPP_BEGIN
+
+/////////////// LatencyHistogram ///////////////
+unsigned LatencyHistogram::bucketOf(std::uint64_t value)
+{
+	if (value < SUB_BUCKETS)
+		return unsigned(value);
+	unsigned exponent = 63 - std::countl_zero(value);
+	unsigned sub = unsigned(value >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+	return SUB_BUCKETS * (exponent - SUB_BUCKET_BITS + 1) + sub;
+}
+std::uint64_t LatencyHistogram::valueOf(unsigned bucket)
+{
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+	unsigned shift = bucket / SUB_BUCKETS - 1;
+	std::uint64_t low = std::uint64_t(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+	return low + ((std::uint64_t(1) << shift) >> 1);
+}
+
+void LatencyHistogram::record(std::uint64_t value)
+{
+	buckets[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(1, std::memory_order_relaxed);
+	value_sum.fetch_add(value, std::memory_order_relaxed);
+	for (auto current = value_max.load(std::memory_order_relaxed); current < value;)
+	{
+		if (value_max.compare_exchange_weak(current, value, std::memory_order_relaxed))
+			break;
+	}
+}
+void LatencyHistogram::reset()
+{
+	for (auto& bucket : buckets)
+		bucket.store(0, std::memory_order_relaxed);
+	total.store(0, std::memory_order_relaxed);
+	value_sum.store(0, std::memory_order_relaxed);
+	value_max.store(0, std::memory_order_relaxed);
+}
+
+std::uint64_t LatencyHistogram::percentile(double q) const
+{
+	std::uint64_t n = count();
+	if (n == 0)
+		return 0;
+	// rank of the value wanted, at least the first one
+	std::uint64_t rank = std::max<std::uint64_t>(1, std::uint64_t(q * double(n) + 0.5));
+	std::uint64_t seen = 0;
+	for (unsigned i = 0; i < BUCKETS; i++)
+	{
+		seen += buckets[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+			return std::min(valueOf(i), max());
+	}
+	return max();
+}
+
+//////////////// CommandMetrics ////////////////
+void CommandMetrics::reset()
+{
+	invocations.store(0, std::memory_order_relaxed);
+	for (auto& code : return_codes)
+		code.store(0, std::memory_order_relaxed);
+	bytes_read.store(0, std::memory_order_relaxed);
+	bytes_written.store(0, std::memory_order_relaxed);
+	wall_time.reset();
+	cpu_time.reset();
+}
+
+//////////////////  Metrics  //////////////////
+CommandMetrics& Metrics::command(StringView name)
+{
+	{
+		std::shared_lock lock(mutex);
+		if (auto it = commands.find(name); it != commands.end())
+			return *it->second;
+	}
+	std::unique_lock lock(mutex);
+	auto& metrics = commands[String(name)];
+	if (!metrics)
+		metrics = std::make_unique<CommandMetrics>();
+	return *metrics;
+}
+
+void Metrics::record(StringView name, const Sample& sample)
+{
+	CommandMetrics& metrics = command(name);
+	metrics.invocations.fetch_add(1, std::memory_order_relaxed);
+	metrics.return_codes[unsigned(sample.return_code) & 0xFF].fetch_add(1, std::memory_order_relaxed);
+	metrics.bytes_read.fetch_add(sample.bytes_read, std::memory_order_relaxed);
+	metrics.bytes_written.fetch_add(sample.bytes_written, std::memory_order_relaxed);
+	metrics.wall_time.record(sample.wall_ns);
+	metrics.cpu_time.record(sample.cpu_ns);
+}
+
+void Metrics::reset()
+{
+	std::shared_lock lock(mutex);
+	for (auto& [name, metrics] : commands)
+		metrics->reset();
+}
+
+void Metrics::forEach(const std::function<void(StringView, const CommandMetrics&)>& fn) const
+{
+	std::shared_lock lock(mutex);
+	for (auto& [name, metrics] : commands)
+		fn(name, *metrics);
+}
+
+/** @brief Escape a label value as the exposition format requires. */
+static String prometheus_label(StringView value)
+{
+	String escaped;
+	escaped.reserve(value.size());
+	for (CharType c : value)
+	{
+		switch (c)
+		{
+		case '\\': escaped += "\\\\"; break;
+		case '"':  escaped += "\\\""; break;
+		case '\n': escaped += "\\n";  break;
+		default:   escaped += c;      break;
+		}
+	}
+	return escaped;
+}
+
+void Metrics::writePrometheus(std::basic_ostream<CharType>& out) const
+{
+	std::shared_lock lock(mutex);
+	auto counter = [&](const char* name, const char* help, auto&& value) {
+		out << fmt::format("# HELP {} {}\n# TYPE {} counter\n", name, help, name);
+		for (auto& [command, metrics] : commands)
+			out << fmt::format("{}{{command=\"{}\"}} {}\n", name, prometheus_label(command), value(*metrics));
+	};
+	auto summary = [&](const char* name, const char* help, LatencyHistogram CommandMetrics::* histogram) {
+		out << fmt::format("# HELP {} {}\n# TYPE {} summary\n", name, help, name);
+		for (auto& [command, metrics] : commands)
+		{
+			const LatencyHistogram& h = (*metrics).*histogram;
+			String label = prometheus_label(command);
+			for (double q : { 0.5, 0.9, 0.99, 0.999 })
+				out << fmt::format("{}{{command=\"{}\",quantile=\"{}\"}} {:.9g}\n", name, label, q, double(h.percentile(q)) * 1e-9);
+			out << fmt::format("{}_sum{{command=\"{}\"}} {:.9g}\n", name, label, double(h.sum()) * 1e-9);
+			out << fmt::format("{}_count{{command=\"{}\"}} {}\n", name, label, h.count());
+		}
+	};
+
+	counter("clipp_command_invocations_total", "Number of times a command has been run.",
+		[](const CommandMetrics& m) { return m.invocations.load(std::memory_order_relaxed); });
+
+	out << "# HELP clipp_command_return_codes_total Number of times a command has returned a code.\n"
+		"# TYPE clipp_command_return_codes_total counter\n";
+	for (auto& [command, metrics] : commands)
+	{
+		String label = prometheus_label(command);
+		for (unsigned code = 0; code < metrics->return_codes.size(); code++)
+		{
+			if (auto n = metrics->return_codes[code].load(std::memory_order_relaxed))
+				out << fmt::format("clipp_command_return_codes_total{{command=\"{}\",code=\"{}\"}} {}\n", label, code, n);
+		}
+	}
+
+	counter("clipp_command_read_bytes_total", "Bytes a command has read from its pipeline input.",
+		[](const CommandMetrics& m) { return m.bytes_read.load(std::memory_order_relaxed); });
+	counter("clipp_command_written_bytes_total", "Bytes a command has written to its pipeline output.",
+		[](const CommandMetrics& m) { return m.bytes_written.load(std::memory_order_relaxed); });
+	summary("clipp_command_wall_seconds", "Wall clock time a command has taken.", &CommandMetrics::wall_time);
+	summary("clipp_command_cpu_seconds", "CPU time the thread running a command has used.", &CommandMetrics::cpu_time);
+}
+
+void Metrics::exportPrometheus(const String& path) const
+{
+	String temporary = path + ".tmp";
+	{
+		std::basic_ofstream<CharType> file(temporary, std::ios_base::trunc);
+		if (!file)
+			throw CLIException(fmt::format("{}: {}", temporary, std::strerror(errno)));
+		writePrometheus(file);
+		file.flush();
+		if (!file)
+			throw CLIException(fmt::format("{}: write error", temporary));
+	}
+	if (std::rename(temporary.data(), path.data()) != 0)
+		throw CLIException(fmt::format("{}: {}", path, std::strerror(errno)));
+}
+
+CLIPP_END
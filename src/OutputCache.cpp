@@ -0,0 +1,111 @@
+#include "../include/CLI++/OutputCache.hpp"
+
+CLIPP_BEGIN
+
+// arguments never contain it, since they are split from a line
+static constexpr CharType KEY_SEPARATOR = '\0';
+
+String OutputCache::makeKey(std::span<const StringView> args, StringView input)
+{
+	std::size_t size = 2 * sizeof(std::uint64_t);
+	for (StringView arg : args)
+		size += arg.size() + 1;
+
+	String key;
+	key.reserve(size);
+	for (StringView arg : args)
+		key.append(arg).push_back(KEY_SEPARATOR);
+	std::uint64_t input_key[2] = { std::uint64_t(input.size()), std::uint64_t(std::hash<StringView>()(input)) };
+	key.append(reinterpret_cast<const char*>(input_key), sizeof(input_key));
+	return key;
+}
+StringView OutputCache::commandOf(const String& key)
+{
+	return StringView(key.data(), key.find(KEY_SEPARATOR));
+}
+
+std::shared_ptr<const OutputCache::Entry> OutputCache::find(std::span<const StringView> args, StringView input)
+{
+	String key = makeKey(args, input);
+	std::lock_guard lock(mutex);
+	auto it = index.find(key);
+	if (it == index.end())
+	{
+		misses++;
+		return nullptr;
+	}
+	// the hash only finds the entry, a collision must not return the output of another input
+	if (it->second->input != input)
+	{
+		misses++;
+		return nullptr;
+	}
+	hits++;
+	lru.splice(lru.begin(), lru, it->second);
+	return it->second->entry;
+}
+
+void OutputCache::insert(std::span<const StringView> args, StringView input, Entry entry)
+{
+	String key = makeKey(args, input);
+	std::size_t size = key.size() + input.size() + entry.output.size();
+	if (size > capacity)
+		return;
+	auto shared = std::make_shared<const Entry>(std::move(entry));
+
+	std::lock_guard lock(mutex);
+	// another session may have run the same invocation meanwhile
+	if (auto it = index.find(key); it != index.end())
+	{
+		bytes -= it->second->size();
+		lru.erase(it->second);
+		index.erase(it);
+	}
+	lru.push_front(Node{ std::move(key), String(input), std::move(shared) });
+	index.emplace(lru.front().key, lru.begin());
+	bytes += size;
+	evict();
+}
+
+void OutputCache::evict()
+{
+	while (bytes > capacity)
+	{
+		Node& last = lru.back();
+		bytes -= last.size();
+		index.erase(last.key);
+		lru.pop_back();
+	}
+}
+
+void OutputCache::invalidate(StringView command)
+{
+	std::lock_guard lock(mutex);
+	for (auto it = lru.begin(); it != lru.end();)
+	{
+		if (commandOf(it->key) != command)
+		{
+			++it;
+			continue;
+		}
+		bytes -= it->size();
+		index.erase(it->key);
+		it = lru.erase(it);
+	}
+}
+
+void OutputCache::clear()
+{
+	std::lock_guard lock(mutex);
+	index.clear();
+	lru.clear();
+	bytes = 0;
+}
+
+OutputCache::Statistics OutputCache::statistics() const
+{
+	std::lock_guard lock(mutex);
+	return Statistics{ hits, misses, lru.size(), bytes };
+}
+
+CLIPP_END
@@ -0,0 +1,371 @@
+#include "../include/CLI++/detail/Process.hpp"
+#include "../include/CLI++/detail/IO.hpp"
+#include "../include/CLI++/Exceptions.hpp"
+
+#include <sstream>
+#include <memory>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+
+#include <spawn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+CLIPP_BEGIN NAMESPACE_BEGIN(detail)
+
+static constexpr std::size_t TRANSFER_CHUNK_SIZE = 64 * 1024;
+
+////////////////  File Descriptor ////////////////
+struct FileDescriptor
+{
+	int fd = -1;
+
+	FileDescriptor() = default;
+	explicit FileDescriptor(int fd) : fd(fd) {}
+	FileDescriptor(const FileDescriptor&) = delete;
+	~FileDescriptor() { close(); }
+
+	void close()
+	{
+		if (fd >= 0)
+			::close(fd);
+		fd = -1;
+	}
+	int release() { int ret = fd; fd = -1; return ret; }
+	bool valid() const { return fd >= 0; }
+};
+
+static void open_pipe(FileDescriptor& read_end, FileDescriptor& write_end)
+{
+	int fds[2];
+	if (::pipe(fds) != 0)
+		throw CLIException(fmt::format("pipe: {}", std::strerror(errno)));
+	// neither end should leak into children, `posix_spawn_file_actions_adddup2`
+	// creates the descriptors they actually need
+	::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	read_end.fd  = fds[0];
+	write_end.fd = fds[1];
+}
+static void set_nonblocking(int fd)
+{
+	int flags = ::fcntl(fd, F_GETFL);
+	::fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+/**
+ * Writing to a pipe whose reader has gone raises `SIGPIPE`, which would kill the whole CLI.
+ * Block it for the calling thread while data is transferred, and discard it afterwards.
+**/
+class SigpipeGuard
+{
+public:
+	SigpipeGuard()
+	{
+		sigemptyset(&sigpipe);
+		sigaddset(&sigpipe, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &sigpipe, &old_mask);
+	}
+	~SigpipeGuard()
+	{
+		sigset_t pending;
+		sigpending(&pending);
+		if (sigismember(&pending, SIGPIPE) && !sigismember(&old_mask, SIGPIPE))
+		{
+			int sig = 0;
+			sigwait(&sigpipe, &sig);
+		}
+		pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+	}
+private:
+	sigset_t sigpipe;
+	sigset_t old_mask;
+};
+
+////////////////  ProcessGroup  ////////////////
+void ProcessGroup::add(pid_t pgid)
+{
+	std::lock_guard lock(mutex);
+	groups.push_back(pgid);
+	if (killed_with != 0)
+		::kill(-pgid, killed_with);
+}
+void ProcessGroup::remove(pid_t pgid)
+{
+	std::lock_guard lock(mutex);
+	std::erase(groups, pgid);
+}
+void ProcessGroup::kill(int sig)
+{
+	std::lock_guard lock(mutex);
+	killed_with = sig;
+	for (pid_t pgid : groups)
+		::kill(-pgid, sig);
+}
+
+/**
+ * @param pgid process group to join, `0` creates a new group led by the spawned process,
+ *             `-1` stays in the group of this process
+**/
+static pid_t spawn_process(const std::vector<String>& args, int in_fd, int out_fd, pid_t pgid)
+{
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (in_fd >= 0 && in_fd != STDIN_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+	if (out_fd >= 0 && out_fd != STDOUT_FILENO)
+		posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+
+	// children must not inherit the blocked `SIGPIPE` of this thread
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
+	sigset_t mask, defaults;
+	sigemptyset(&mask);
+	sigemptyset(&defaults);
+	sigaddset(&defaults, SIGPIPE);
+	posix_spawnattr_setsigmask(&attr, &mask);
+	posix_spawnattr_setsigdefault(&attr, &defaults);
+	short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+	if (pgid >= 0)
+	{
+		posix_spawnattr_setpgroup(&attr, pgid);
+		flags |= POSIX_SPAWN_SETPGROUP;
+	}
+	posix_spawnattr_setflags(&attr, flags);
+
+	std::vector<char*> argv;
+	argv.reserve(args.size() + 1);
+	for (auto& arg : args)
+		argv.push_back(const_cast<char*>(arg.data()));
+	argv.push_back(nullptr);
+
+	pid_t pid = -1;
+	int err = posix_spawnp(&pid, argv[0], &actions, &attr, argv.data(), environ);
+
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	if (err != 0)
+	{
+		fmt::print(stderr, "{}: {}\n", args.front(), std::strerror(err));
+		return -1;
+	}
+	return pid;
+}
+
+static int wait_process(pid_t pid)
+{
+	if (pid < 0)
+		return 127;
+
+	int status = 0;
+	while (::waitpid(pid, &status, 0) < 0)
+	{
+		if (errno != EINTR)
+			return 127;
+	}
+	if (WIFSIGNALED(status))
+		return 128 + WTERMSIG(status);
+	return WEXITSTATUS(status);
+}
+
+/**
+ * Source of the data fed to the first process. Contents of a `std::stringbuf` or a `ViewStreamBuf`
+ * are used in place, those pages stay untouched until all children are reaped, so they can be
+ * spliced into the pipe. Other stream buffers are read in chunks.
+**/
+class InputFeeder
+{
+public:
+	explicit InputFeeder(std::basic_istream<CharType>* in)
+		: buf(in ? in->rdbuf() : nullptr)
+		, stable(false), finished(buf == nullptr)
+	{
+		if (auto string_buf = dynamic_cast<std::basic_stringbuf<CharType>*>(buf))
+		{
+			auto pos = string_buf->pubseekoff(0, std::ios_base::cur, std::ios_base::in);
+			pending = string_buf->view();
+			pending.remove_prefix(pos < 0 ? pending.size() : std::min<std::size_t>(pos, pending.size()));
+			stable = finished = true;
+		}
+		else if (auto view_buf = dynamic_cast<ViewStreamBuf*>(buf))
+		{
+			pending = view_buf->remaining();
+			stable = finished = true;
+		}
+	}
+	~InputFeeder()
+	{
+		// whatever has been handed to the process is consumed
+		if (stable)
+			buf->pubseekoff(0, std::ios_base::end, std::ios_base::in);
+	}
+
+	/** @brief Data waiting to be written, empty means the input is exhausted. */
+	StringView next()
+	{
+		if (pending.empty() && !finished)
+		{
+			if (!chunk)
+				chunk.reset(new CharType[TRANSFER_CHUNK_SIZE]);
+			auto n = buf->sgetn(chunk.get(), TRANSFER_CHUNK_SIZE);
+			if (n <= 0)
+				finished = true;
+			else
+				pending = StringView(chunk.get(), n);
+		}
+		return pending;
+	}
+	void consume(std::size_t n) { pending.remove_prefix(n); }
+
+	/** @brief Write as much pending data to `fd` as it accepts, return the result of the syscall. */
+	ssize_t push(int fd)
+	{
+#ifdef __linux__
+		if (stable && use_vmsplice)
+		{
+			iovec iov{ const_cast<CharType*>(pending.data()), pending.size() * sizeof(CharType) };
+			ssize_t n = ::vmsplice(fd, &iov, 1, SPLICE_F_NONBLOCK);
+			if (n >= 0 || (errno != EINVAL && errno != ENOSYS))
+				return n;
+			use_vmsplice = false;
+		}
+#endif
+		return ::write(fd, pending.data(), pending.size() * sizeof(CharType));
+	}
+
+private:
+	std::basic_streambuf<CharType>* buf;
+	std::unique_ptr<CharType[]> chunk;
+	StringView pending;
+	bool stable;
+	bool finished;
+	bool use_vmsplice = true;
+};
+
+int run_process_chain(const std::vector<std::vector<String>>& chain, const ProcessIO& io)
+{
+	if (chain.empty())
+		return 0;
+
+	SigpipeGuard sigpipe_guard;
+	// anything printed so far must show up before the output of children
+	std::fflush(stdout);
+
+	std::vector<pid_t> pids;
+	pids.reserve(chain.size());
+	int ret_code = 0;
+	pid_t pgid = io.group != nullptr ? 0 : -1;
+	// reap children even if setting up the chain throws
+	struct Reaper
+	{
+		std::vector<pid_t>& pids;
+		int& ret_code;
+		const pid_t& pgid;
+		ProcessGroup* group;
+		~Reaper()
+		{
+			for (pid_t pid : pids)
+				ret_code |= wait_process(pid);
+			if (group != nullptr && pgid > 0)
+				group->remove(pgid);
+		}
+	};
+
+	{
+		Reaper reaper{ pids, ret_code, pgid, io.group };
+		// declared after `reaper` so that they are closed before waiting for children
+		FileDescriptor feed, drain, stage_in;
+		if (io.in != nullptr)
+			open_pipe(stage_in, feed);
+
+		for (std::size_t i = 0; i < chain.size(); i++)
+		{
+			FileDescriptor stage_out, next_in;
+			if (i + 1 < chain.size())
+				open_pipe(next_in, stage_out);
+			else if (io.out != nullptr)
+				open_pipe(drain, stage_out);
+
+			int in_fd  = stage_in.valid()  ? stage_in.fd  : (i == 0 ? io.in_fd : -1);
+			int out_fd = stage_out.valid() ? stage_out.fd : io.out_fd;
+			pid_t pid = spawn_process(chain[i], in_fd, out_fd, pgid);
+			pids.push_back(pid);
+			if (pgid == 0 && pid > 0)
+			{
+				// the first process spawned leads the group of the whole chain
+				pgid = pid;
+				io.group->add(pgid);
+			}
+
+			// descriptors given to the child are no longer needed here, keeping them
+			// open would prevent the other side from seeing EOF
+			stage_in.close();
+			stage_in.fd = next_in.release();
+		}
+
+		if (feed.valid())
+			set_nonblocking(feed.fd);
+		if (drain.valid())
+			set_nonblocking(drain.fd);
+
+		InputFeeder feeder(io.in);
+		std::unique_ptr<CharType[]> buffer;
+		if (drain.valid())
+			buffer.reset(new CharType[TRANSFER_CHUNK_SIZE]);
+
+		while (feed.valid() || drain.valid())
+		{
+			if (feed.valid() && feeder.next().empty())
+				feed.close();	// EOF for the first process
+
+			pollfd fds[2];
+			nfds_t count = 0;
+			if (feed.valid())
+				fds[count++] = { feed.fd, POLLOUT, 0 };
+			if (drain.valid())
+				fds[count++] = { drain.fd, POLLIN, 0 };
+			if (count == 0)
+				break;
+
+			if (::poll(fds, count, -1) < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				throw CLIException(fmt::format("poll: {}", std::strerror(errno)));
+			}
+
+			for (nfds_t i = 0; i < count; i++)
+			{
+				if (fds[i].revents == 0)
+					continue;
+				if (fds[i].fd == feed.fd)
+				{
+					ssize_t n = feeder.push(feed.fd);
+					if (n >= 0)
+						feeder.consume(n / sizeof(CharType));
+					else if (errno != EAGAIN && errno != EINTR)
+						feed.close();	// reader is gone, drop the rest
+				}
+				else
+				{
+					ssize_t n = ::read(drain.fd, buffer.get(), TRANSFER_CHUNK_SIZE * sizeof(CharType));
+					if (n > 0)
+						io.out->write(buffer.get(), n / sizeof(CharType));
+					else if (n == 0 || (errno != EAGAIN && errno != EINTR))
+						drain.close();
+				}
+			}
+		}
+	}
+	return ret_code;
+}
+
+NAMESPACE_END(detail) CLIPP_END
@@ -0,0 +1,502 @@
+#include "../include/CLI++/Server.hpp"
+#include "../include/CLI++/detail/IO.hpp"
+#include "../include/CLI++/detail/ThreadPool.hpp"
+
+#include <deque>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+CLIPP_BEGIN
+
+static constexpr std::size_t RECEIVE_CHUNK_SIZE = 64 * 1024;
+static constexpr std::size_t OUTPUT_BUFFER_SIZE = 16 * 1024;
+// a client sending this much without a newline is dropped
+static constexpr std::size_t MAX_LINE_LENGTH = 1 << 20;
+
+static CLIException make_socket_error(const char* what)
+{
+	return CLIException(fmt::format("{}: {}", what, std::strerror(errno)));
+}
+
+////////////////   Connection   ////////////////
+struct CLIServer::Connection : std::enable_shared_from_this<CLIServer::Connection>
+{
+	int fd;
+	// touched by the event loop only
+	String input;		// received characters that don't form a complete line yet
+	String sending;		// output being written to the socket
+	bool want_write = false;
+	bool registered = true;	// in the epoll set, it's removed once there's nothing to wait for
+	bool closed = false;
+
+	// shared between the event loop and the worker running lines of this connection
+	std::mutex mutex;
+	std::deque<String> lines;
+	String output;			// printed by the session, not taken by the event loop yet
+	bool running = false;	// a worker is running lines
+	bool eof = false;		// client won't send any more lines
+	bool exited = false;	// session ran `exit`
+
+	// session state, only used by the worker running lines
+	detail::ViewInputStream terminal_in;
+	std::unique_ptr<SessionOutputBuf> terminal_buf;
+	std::unique_ptr<std::basic_ostream<CharType>> terminal_out;
+	// errors are flushed as they're printed, background jobs may report them while a line runs
+	std::unique_ptr<SessionOutputBuf> error_buf;
+	std::unique_ptr<std::basic_ostream<CharType>> error_out;
+	// destroyed first, its background jobs may still print to the streams above
+	std::unique_ptr<CLI> session;
+
+	explicit Connection(int fd) : fd(fd) {}
+
+	bool done() const
+	{
+		return (eof || exited) && !running && lines.empty() && output.empty();
+	}
+};
+
+/** @brief Collects what a session prints and hands it to the event loop in large chunks. */
+class CLIServer::SessionOutputBuf : public std::basic_streambuf<CharType>
+{
+public:
+	SessionOutputBuf(CLIServer& server, Connection& conn)
+		: server(server), conn(conn)
+	{
+		this->setp(buffer, buffer + OUTPUT_BUFFER_SIZE);
+	}
+	virtual ~SessionOutputBuf() = default;
+protected:
+	virtual int_type overflow(int_type ch) override
+	{
+		flush(nullptr, 0);
+		if (!traits_type::eq_int_type(ch, traits_type::eof()))
+		{
+			*pptr() = traits_type::to_char_type(ch);
+			this->pbump(1);
+		}
+		return traits_type::not_eof(ch);
+	}
+	virtual std::streamsize xsputn(const char_type* s, std::streamsize n) override
+	{
+		if (n <= epptr() - pptr())
+		{
+			traits_type::copy(pptr(), s, n);
+			this->pbump(int(n));
+		}
+		else
+			flush(s, n);
+		return n;
+	}
+	virtual int sync() override
+	{
+		flush(nullptr, 0);
+		return 0;
+	}
+private:
+	void flush(const char_type* s, std::size_t n)
+	{
+		std::size_t buffered = pptr() - pbase();
+		if (buffered + n == 0)
+			return;
+		bool was_empty;
+		{
+			std::lock_guard lock(conn.mutex);
+			was_empty = conn.output.empty();
+			conn.output.append(pbase(), buffered);
+			conn.output.append(s, n);
+		}
+		this->setp(buffer, buffer + OUTPUT_BUFFER_SIZE);
+		// otherwise the event loop has been woken and not taken the output yet,
+		// nobody is going to send anything once the connection is being destroyed
+		if (auto self = conn.weak_from_this().lock(); was_empty && self)
+			server.wake(self);
+	}
+
+	CLIServer& server;
+	Connection& conn;
+	char_type buffer[OUTPUT_BUFFER_SIZE];
+};
+
+////////////////   CLIServer   ////////////////
+CLIServer::CLIServer(std::shared_ptr<const CommandRegistry> commands, std::size_t threads)
+	: registry(std::move(commands))
+	, workers(new detail::ThreadPool(threads != 0 ? threads : std::max(1u, std::thread::hardware_concurrency())))
+	, prompt(), session_metrics(std::make_shared<Metrics>()), session_cache(std::make_shared<OutputCache>()), epoll_fd(-1), wake_fd(-1), stopping(false)
+{
+	if (!registry)
+		throw CLIException("CLIServer needs a command registry.");
+
+	epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		throw make_socket_error("epoll_create1");
+	wake_fd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wake_fd < 0)
+	{
+		auto err = make_socket_error("eventfd");
+		::close(epoll_fd);
+		throw err;
+	}
+	epoll_event ev{ EPOLLIN, { .fd = wake_fd } };
+	::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wake_fd, &ev);
+}
+
+CLIServer::~CLIServer()
+{
+	for (auto& [fd, conn] : connections)
+	{
+		{
+			std::lock_guard lock(conn->mutex);
+			conn->lines.clear();
+			conn->eof = true;
+		}
+		::close(fd);
+		conn->closed = true;
+	}
+	connections.clear();
+	// lines still running finish here, they may wake the loop, so `wake_fd` stays open until then
+	workers.reset();
+
+	for (int fd : listeners)
+		::close(fd);
+	for (auto& path : socket_paths)
+		::unlink(path.data());
+	::close(wake_fd);
+	::close(epoll_fd);
+}
+
+void CLIServer::listenUnix(const String& path)
+{
+	sockaddr_un addr{};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path))
+		throw CLIException(fmt::format("{}: socket path too long", path));
+	std::memcpy(addr.sun_path, path.data(), path.size());
+
+	// a socket left behind by a previous server would make `bind` fail
+	struct stat st;
+	if (::stat(path.data(), &st) == 0 && S_ISSOCK(st.st_mode))
+		::unlink(path.data());
+
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		throw make_socket_error("socket");
+	if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0)
+	{
+		auto err = CLIException(fmt::format("{}: {}", path, std::strerror(errno)));
+		::close(fd);
+		throw err;
+	}
+	epoll_event ev{ EPOLLIN, { .fd = fd } };
+	::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	listeners.push_back(fd);
+	socket_paths.push_back(path);
+}
+
+std::uint16_t CLIServer::listenTcp(std::uint16_t port)
+{
+	sockaddr_in addr{};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		throw make_socket_error("socket");
+	int on = 1;
+	::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	socklen_t len = sizeof(addr);
+	if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(fd, SOMAXCONN) != 0
+		|| ::getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0)
+	{
+		auto err = CLIException(fmt::format("127.0.0.1:{}: {}", port, std::strerror(errno)));
+		::close(fd);
+		throw err;
+	}
+	epoll_event ev{ EPOLLIN, { .fd = fd } };
+	::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+	listeners.push_back(fd);
+	return ntohs(addr.sin_port);
+}
+
+void CLIServer::run()
+{
+	epoll_event events[64];
+	while (!stopping)
+	{
+		int count = ::epoll_wait(epoll_fd, events, 64, -1);
+		if (count < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			throw make_socket_error("epoll_wait");
+		}
+		for (int i = 0; i < count; i++)
+		{
+			int fd = events[i].data.fd;
+			if (fd == wake_fd)
+			{
+				eventfd_t value;
+				::eventfd_read(wake_fd, &value);
+				std::vector<std::weak_ptr<Connection>> pending;
+				{
+					std::lock_guard lock(wake_mutex);
+					pending.swap(woken);
+				}
+				for (auto& weak : pending)
+				{
+					if (auto conn = weak.lock(); conn && !conn->closed)
+						send(conn);
+				}
+				continue;
+			}
+			if (std::find(listeners.begin(), listeners.end(), fd) != listeners.end())
+			{
+				accept(fd);
+				continue;
+			}
+
+			auto it = connections.find(fd);
+			if (it == connections.end())
+				continue;
+			auto conn = it->second;
+			if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+				receive(conn);
+			if (!conn->closed && (events[i].events & EPOLLOUT))
+				send(conn);
+		}
+	}
+	stopping = false;
+}
+
+void CLIServer::stop()
+{
+	stopping = true;
+	::eventfd_write(wake_fd, 1);
+}
+
+void CLIServer::wake(const std::shared_ptr<Connection>& conn)
+{
+	{
+		std::lock_guard lock(wake_mutex);
+		woken.push_back(conn);
+	}
+	::eventfd_write(wake_fd, 1);
+}
+
+void CLIServer::accept(int listener)
+{
+	while (true)
+	{
+		int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+		if (fd < 0)
+		{
+			// EAGAIN: all pending connections are accepted, anything else is the client's problem
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			return;
+		}
+
+		auto conn = std::make_shared<Connection>(fd);
+		conn->terminal_buf.reset(new SessionOutputBuf(*this, *conn));
+		conn->terminal_out.reset(new std::basic_ostream<CharType>(conn->terminal_buf.get()));
+		conn->error_buf.reset(new SessionOutputBuf(*this, *conn));
+		conn->error_out.reset(new std::basic_ostream<CharType>(conn->error_buf.get()));
+		conn->session.reset(new CLI(registry, prompt));
+		conn->session->setMetrics(session_metrics);
+		conn->session->setOutputCache(session_cache);
+#if CLIPP_ENABLE_TRACING
+		for (auto& hook : trace_hooks)
+			conn->session->addTraceHook(hook);
+#endif
+		conn->session->setTerminal(&conn->terminal_in, conn->terminal_out.get(), conn->error_out.get());
+		conn->output = prompt;
+
+		epoll_event ev{ EPOLLIN, { .fd = fd } };
+		::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+		connections.emplace(fd, conn);
+		if (!prompt.empty())
+			send(conn);
+	}
+}
+
+void CLIServer::receive(const std::shared_ptr<Connection>& conn)
+{
+	CharType buffer[RECEIVE_CHUNK_SIZE];
+	ssize_t n = ::recv(conn->fd, buffer, sizeof(buffer), 0);
+	if (n < 0 && (errno == EAGAIN || errno == EINTR))
+		return;
+	if (n < 0)
+	{
+		close(conn);
+		return;
+	}
+
+	bool start = false;
+	bool overlong = false;
+	{
+		std::lock_guard lock(conn->mutex);
+		if (n == 0)
+		{
+			// the client has shut down its side, finish lines received so far
+			conn->eof = true;
+			if (!detail::is_empty_string(conn->input))
+				conn->lines.push_back(std::move(conn->input));
+			conn->input.clear();
+		}
+		else
+		{
+			conn->input.append(buffer, n);
+			std::size_t begin = 0;
+			for (std::size_t eol; (eol = conn->input.find('\n', begin)) != String::npos; begin = eol + 1)
+			{
+				std::size_t end = (eol > begin && conn->input[eol - 1] == '\r') ? eol - 1 : eol;
+				conn->lines.emplace_back(conn->input, begin, end - begin);
+			}
+			conn->input.erase(0, begin);
+			overlong = conn->input.size() > MAX_LINE_LENGTH;
+		}
+		start = !conn->running && !conn->lines.empty() && !conn->exited;
+		if (start)
+			conn->running = true;
+	}
+
+	if (overlong)
+	{
+		close(conn);
+		return;
+	}
+	// a hung up socket keeps reporting EPOLLHUP, it's only watched while output is pending
+	if (n == 0)
+		watch(conn, false);
+	if (start)
+		workers->submit([this, conn]() { runLines(conn); });
+	else
+		send(conn);
+}
+
+void CLIServer::runLines(std::shared_ptr<Connection> conn)
+{
+	while (true)
+	{
+		String line;
+		{
+			std::lock_guard lock(conn->mutex);
+			if (conn->lines.empty() || conn->exited)
+			{
+				conn->lines.clear();
+				conn->running = false;
+				break;
+			}
+			line = std::move(conn->lines.front());
+			conn->lines.pop_front();
+		}
+
+		bool alive = conn->session->runLine(line);
+		if (!alive)
+		{
+			std::lock_guard lock(conn->mutex);
+			conn->exited = true;
+		}
+		else if (!prompt.empty())
+			*conn->terminal_out << prompt;
+		conn->terminal_out->flush();
+	}
+	// the event loop decides whether the connection is done
+	wake(conn);
+}
+
+void CLIServer::send(const std::shared_ptr<Connection>& conn)
+{
+	bool done = false;
+	{
+		std::lock_guard lock(conn->mutex);
+		if (conn->sending.empty())
+			conn->sending.swap(conn->output);
+		else
+		{
+			conn->sending.append(conn->output);
+			conn->output.clear();
+		}
+		done = conn->done();
+	}
+
+	std::size_t sent = 0;
+	while (sent < conn->sending.size())
+	{
+		ssize_t n = ::send(conn->fd, conn->sending.data() + sent, conn->sending.size() - sent, MSG_NOSIGNAL);
+		if (n >= 0)
+		{
+			sent += n;
+			continue;
+		}
+		if (errno == EINTR)
+			continue;
+		if (errno == EAGAIN)
+			break;
+		close(conn);
+		return;
+	}
+	conn->sending.erase(0, sent);
+
+	if (conn->sending.empty() && done)
+	{
+		close(conn);
+		return;
+	}
+	bool want_write = !conn->sending.empty();
+	if (want_write != conn->want_write)
+	{
+		bool reading;
+		{
+			std::lock_guard lock(conn->mutex);
+			reading = !conn->eof;
+		}
+		conn->want_write = want_write;
+		watch(conn, reading);
+	}
+}
+
+void CLIServer::watch(const std::shared_ptr<Connection>& conn, bool reading)
+{
+	std::uint32_t events = (reading ? std::uint32_t(EPOLLIN) : 0u) | (conn->want_write ? std::uint32_t(EPOLLOUT) : 0u);
+	if (events == 0)
+	{
+		if (conn->registered)
+			::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, nullptr);
+		conn->registered = false;
+		return;
+	}
+	epoll_event ev{ events, { .fd = conn->fd } };
+	::epoll_ctl(epoll_fd, conn->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, conn->fd, &ev);
+	conn->registered = true;
+}
+
+void CLIServer::close(const std::shared_ptr<Connection>& conn)
+{
+	if (conn->closed)
+		return;
+	{
+		std::lock_guard lock(conn->mutex);
+		conn->lines.clear();
+		conn->eof = true;
+	}
+	// closing the descriptor removes it from the epoll set
+	::close(conn->fd);
+	conn->closed = true;
+	// the session is destroyed by whoever holds the last reference, possibly a worker
+	connections.erase(conn->fd);
+}
+
+CLIPP_END
@@ -0,0 +1,151 @@
+#include "../include/CLI++/Suggestion.hpp"
+
+#include <vector>
+
+CLIPP_BEGIN
+
+// follows the last word of a line, never part of a word since words are split at whitespace
+static const String END_OF_LINE = "\n";
+
+static bool is_space(CharType c)
+{
+	return c == ' ' || c == '\t';
+}
+static std::vector<StringView> split_words(StringView line)
+{
+	std::vector<StringView> words;
+	std::size_t pos = 0;
+	while (pos < line.size())
+	{
+		while (pos < line.size() && is_space(line[pos]))
+			pos++;
+		std::size_t start = pos;
+		while (pos < line.size() && !is_space(line[pos]))
+			pos++;
+		if (pos > start)
+			words.push_back(line.substr(start, pos - start));
+	}
+	return words;
+}
+
+/** @brief Context keys: two words apart from one word, so they never collide. */
+static StringView context_key(String& key, StringView before_last, StringView last)
+{
+	key.assign(before_last).push_back('\x1f');
+	key.append(last);
+	return key;
+}
+static StringView context_key(String& key, StringView last)
+{
+	key.assign(1, '\x1e').append(last);
+	return key;
+}
+
+void SuggestionModel::learn(StringView line)
+{
+	auto words = split_words(line);
+	if (words.empty())
+		return;
+
+	std::lock_guard lock(mutex);
+	// look up before inserting, so strings are only created for new keys
+	auto count = [this](StringView key, StringView word) {
+		auto context = contexts.find(key);
+		if (context == contexts.end())
+			context = contexts.emplace(String(key), Followers()).first;
+		Followers& followers = context->second;
+		auto it = followers.counts.find(word);
+		if (it == followers.counts.end())
+			it = followers.counts.emplace(String(word), 0).first;
+		followers.total++;
+		if (++it->second > followers.best_count)
+		{
+			followers.best = &it->first;
+			followers.best_count = it->second;
+		}
+	};
+
+	String key;
+	StringView before_last, last;	// empty at the start of a line
+	for (std::size_t i = 0; i <= words.size(); i++)
+	{
+		StringView word = i < words.size() ? words[i] : StringView(END_OF_LINE);
+		count(context_key(key, before_last, last), word);
+		count(context_key(key, last), word);
+		before_last = last;
+		last = word;
+	}
+	lines++;
+}
+
+std::size_t SuggestionModel::size() const
+{
+	std::lock_guard lock(mutex);
+	return lines;
+}
+
+const String* SuggestionModel::predict(StringView before_last, StringView last, StringView partial, bool confident) const
+{
+	String key;
+	// the longer context is more precise, the shorter one knows more words
+	for (int order = 2; order > 0; order--)
+	{
+		auto it = contexts.find(order == 2 ? context_key(key, before_last, last) : context_key(key, last));
+		if (it == contexts.end())
+			continue;
+		const Followers& followers = it->second;
+
+		const String* best = followers.best;
+		std::uint32_t best_count = followers.best_count;
+		if (!partial.empty())
+		{
+			best = nullptr;
+			best_count = 0;
+			for (auto& [word, count] : followers.counts)
+			{
+				if (count > best_count && word.starts_with(partial))
+				{
+					best = &word;
+					best_count = count;
+				}
+			}
+		}
+		if (best != nullptr && (!confident || best_count * 2 > followers.total))
+			return best;
+	}
+	return nullptr;
+}
+
+String SuggestionModel::suggest(StringView prefix) const
+{
+	if (prefix.empty())
+		return String();
+	auto words = split_words(prefix);
+	StringView partial;
+	if (!is_space(prefix.back()))
+	{
+		partial = words.back();
+		words.pop_back();
+	}
+	StringView before_last = words.size() > 1 ? words[words.size() - 2] : StringView();
+	StringView last = words.empty() ? StringView() : words.back();
+
+	std::lock_guard lock(mutex);
+	String suggestion;
+	for (std::size_t n = 0; n < max_words; n++)
+	{
+		// the word being typed is always completed, guesses beyond it have to be likely
+		const String* next = predict(before_last, last, partial, n > 0);
+		if (next == nullptr || *next == END_OF_LINE)
+			break;
+		if (partial.empty() && n > 0)
+			suggestion.push_back(' ');
+		suggestion.append(*next, partial.size());
+		partial = StringView();
+		before_last = last;
+		last = *next;
+	}
+	return suggestion;
+}
+
+CLIPP_END
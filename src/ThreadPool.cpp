@@ -0,0 +1,196 @@
+#include "../include/CLI++/detail/ThreadPool.hpp"
+
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <memory>
+
+CLIPP_BEGIN NAMESPACE_BEGIN(detail)
+
+ThreadPool::ThreadPool(std::size_t threads)
+	: stopping(false)
+{
+	workers.reserve(threads);
+	for (std::size_t i = 0; i < threads; i++)
+		workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard lock(mutex);
+		stopping = true;
+	}
+	cond.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+void ThreadPool::submit(Task task)
+{
+	{
+		std::lock_guard lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	cond.notify_one();
+}
+
+void ThreadPool::work()
+{
+	while (true)
+	{
+		Task task;
+		{
+			std::unique_lock lock(mutex);
+			cond.wait(lock, [this]() { return stopping || !tasks.empty(); });
+			if (tasks.empty())
+				return;	// stopping, and nothing left to do
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+/////////////// Work Stealing ///////////////
+namespace {
+/** @brief Indices `[begin, end)` still to be run by a worker. */
+struct WorkRange
+{
+	std::mutex mutex;
+	std::size_t begin = 0;
+	std::size_t end = 0;
+
+	bool pop(std::size_t& index)
+	{
+		std::lock_guard lock(mutex);
+		if (begin == end)
+			return false;
+		index = begin++;
+		return true;
+	}
+	std::size_t size()
+	{
+		std::lock_guard lock(mutex);
+		return end - begin;
+	}
+};
+
+/** @brief Lets workers of a `parallel_for` in until it's closed, closing waits for those inside. */
+struct WorkerGate
+{
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::size_t inside = 0;
+	bool closed = false;
+
+	bool enter()
+	{
+		std::lock_guard lock(mutex);
+		if (closed)
+			return false;
+		inside++;
+		return true;
+	}
+	void leave()
+	{
+		{
+			std::lock_guard lock(mutex);
+			inside--;
+		}
+		cond.notify_all();
+	}
+	void close()
+	{
+		std::unique_lock lock(mutex);
+		closed = true;
+		cond.wait(lock, [this]() { return inside == 0; });
+	}
+};
+}
+
+void parallel_for(ThreadPool& pool, std::size_t count, std::size_t threads,
+                  const std::function<void(std::size_t, std::size_t)>& task)
+{
+	threads = std::max<std::size_t>(1, std::min({ threads, count, pool.size() + 1 }));
+	if (count == 0)
+		return;
+
+	std::vector<WorkRange> ranges(threads);
+	for (std::size_t i = 0; i < threads; i++)
+	{
+		ranges[i].begin = count * i / threads;
+		ranges[i].end   = count * (i + 1) / threads;
+	}
+
+	std::atomic<bool> failed = false;
+	std::exception_ptr error;
+	std::mutex error_mutex;
+
+	auto steal = [&ranges](std::size_t thief) {
+		// take the back half of the largest share
+		std::size_t victim = thief;
+		std::size_t most = 0;
+		for (std::size_t i = 0; i < ranges.size(); i++)
+		{
+			if (std::size_t n = ranges[i].size(); i != thief && n > most)
+				victim = i, most = n;
+		}
+		if (victim == thief)
+			return false;
+
+		std::size_t begin, end;
+		{
+			std::lock_guard lock(ranges[victim].mutex);
+			std::size_t left = ranges[victim].end - ranges[victim].begin;
+			if (left == 0)
+				return true;	// someone else was faster, look again
+			end = ranges[victim].end;
+			begin = end - (left + 1) / 2;
+			ranges[victim].end = begin;
+		}
+		std::lock_guard lock(ranges[thief].mutex);
+		ranges[thief].begin = begin;
+		ranges[thief].end = end;
+		return true;
+	};
+	auto work = [&](std::size_t worker) {
+		std::size_t index = 0;
+		while (!failed)
+		{
+			if (!ranges[worker].pop(index))
+			{
+				if (!steal(worker))
+					return;
+				continue;
+			}
+			try { task(worker, index); }
+			catch(...)
+			{
+				std::lock_guard lock(error_mutex);
+				if (!error)
+					error = std::current_exception();
+				failed = true;
+			}
+		}
+	};
+
+	// the pool may start a worker after this call returned, it must not touch the state above then
+	auto gate = std::make_shared<WorkerGate>();
+	for (std::size_t i = 1; i < threads; i++)
+	{
+		pool.submit([gate, &work, i]() {
+			if (gate->enter())
+			{
+				work(i);
+				gate->leave();
+			}
+		});
+	}
+	work(0);
+	gate->close();
+	if (error)
+		std::rethrow_exception(error);
+}
+
+NAMESPACE_END(detail) CLIPP_END
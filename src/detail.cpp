@@ -93,44 +93,44 @@ ArgvError copy_cooked_string(CharT*& dest_p, const CharT*& src_p)
 	}
 }
 template<typename CharT>
-void handle_operator(CharT*& dest, const CharT*& src)
+void handle_operator(CharT op, CharT*& dest, const CharT*& src)
 {
 	CharT ch = *src;
-	switch (ch)
+	switch (op)
 	{
 	case '&':
+		if (ch != '&' && ch != '|')
+			return;
+		break;
 	case '|':
-		*(dest++) = ch;
-		src++;
+		if (ch != '&' && ch != '|' && ch != '>')
+			return;
 		break;
-	default:
+	case '>':
+		if (ch != '>')
+			return;
 		break;
+	default:
+		return;
 	}
+	*(dest++) = ch;
+	src++;
 }
 
-std::vector<String> split_token(StringView str, ArgvError* _err)
+bool TokenScanner::next(StringView& token)
 {
-	using Char = String::value_type;
-	std::vector<String> ret;
-	ret.reserve(10);
-
-	ArgvError err = ArgvError::OK;
-
-	std::unique_ptr<Char, void (*)(void*)> buffer(strdup(str.data()), std::free);
-	const Char* scan = str.data();
-	Char* dest = buffer.get();
-	Char* token = dest;
-
-	while (*scan != STR_TERMINATE && (err == ArgvError::OK))
+	// empty tokens, e.g. `""`, are skipped
+	while (err.type == ArgvError::OK)
 	{
-		while (std::isspace(*scan)) scan++;
-		if (*scan == STR_TERMINATE) break;
-		dest = token;
+		while (std::isspace(static_cast<unsigned char>(*scan))) scan++;
+		if (*scan == STR_TERMINATE)
+			return false;
 
+		CharType* begin = dest;
 		bool token_done = false;
-		while (!token_done && (err == ArgvError::OK))
+		while (!token_done && (err.type == ArgvError::OK))
 		{
-			Char ch = *(scan++);
+			CharType ch = *(scan++);
 			switch (ch)
 			{
 			case STR_TERMINATE:
@@ -138,10 +138,10 @@ std::vector<String> split_token(StringView str, ArgvError* _err)
 				token_done = true;
 				break;
 			case '\\':
+				if (*scan == STR_TERMINATE)	// ignore last invalid escape
+					break;
 				ch = handle_escape(scan);
 				*(dest++) = ch;
-			// 	if (*scan == STR_TERMINATE)	// ignore last invalid escape
-			// 		token_done = true;
 				break;
 
 			case '\'':
@@ -152,18 +152,34 @@ std::vector<String> split_token(StringView str, ArgvError* _err)
 				err = copy_cooked_string(dest, scan);
 				break;
 
-			case '&':
-			case '|':
-			// case '(':
-			// case ')':
-				if (token != dest)
-					ret.emplace_back(token, dest);
-				*(dest = token) = ch;
-				handle_operator(++dest, scan);
-
+			case ',':
+				if (depth == 0)
+				{
+					*(dest++) = ch;
+					break;
+				}
+				[[fallthrough]];
 			case '(':
 			case ')':
-				// don't handle '(' and ')' currently, treat them as token end
+			case '&':
+			case '|':
+			case '<':
+			case '>':
+				// an operator is a token of its own, the one before it is returned first
+				if (begin != dest)
+				{
+					scan--;
+					token_done = true;
+					break;
+				}
+				if (ch == '(')
+					depth++;
+				else if (ch == ')' && depth > 0)
+					depth--;
+				*dest = ch;
+				handle_operator(ch, ++dest, scan);
+				token_done = true;
+				break;
 			case ' ':
 			case '\t':
 			case '\n':
@@ -174,18 +190,53 @@ std::vector<String> split_token(StringView str, ArgvError* _err)
 				token_done = true;
 				break;
 			default:
-				*(dest++) = ch;
+				// leave characters that don't move alone, pages of a mapped file stay clean
+				if (dest != scan - 1)
+					*dest = ch;
+				dest++;
 			}
 		}
-		if (token != dest)
-			ret.emplace_back(token, dest);
+		// a token cut by an unbalanced quote is still returned, the error stops the next call
+		if (begin != dest)
+		{
+			token = StringView(begin, dest - begin);
+			return true;
+		}
 	}
+	return false;
+}
+
+std::vector<String> split_token(StringView str, ArgvError* _err)
+{
+	std::vector<String> ret;
+	ret.reserve(10);
 
-	if (_err != nullptr) *_err = err;
+	String buffer(str);
+	TokenScanner scanner(buffer.data());
+	for (StringView token; scanner.next(token); )
+		ret.emplace_back(token);
+	if (_err != nullptr) *_err = scanner.error();
 
 	ret.shrink_to_fit();
 	return ret;
 }
+
+std::pmr::vector<StringView> split_token(StringView str, std::pmr::memory_resource* resource, ArgvError* _err)
+{
+	using Char = String::value_type;
+	std::pmr::vector<StringView> ret(resource);
+	ret.reserve(16);
+
+	std::pmr::polymorphic_allocator<Char> alloc(resource);
+	Char* buffer = alloc.allocate(str.size() + 1);
+	std::copy(str.begin(), str.end(), buffer);
+	buffer[str.size()] = STR_TERMINATE;
+	TokenScanner scanner(buffer);
+	for (StringView token; scanner.next(token); )
+		ret.push_back(token);
+	if (_err != nullptr) *_err = scanner.error();
+	return ret;
+}
 //////////// String To Argv ////////////
 
 
@@ -0,0 +1,113 @@
+#include "../include/CLI++/CLI++.hpp"
+#include <limits>
+#include <cstdlib>
+#include <new>
+
+SET_CLIPP_ALIAS(CLI);
+
+// every allocation of this program is counted, `CLI::lineAllocations` only keeps those made by lines
+static void* counted_alloc(std::size_t size, std::size_t align = 0)
+{
+	CLI::record_allocation(size);
+	if (size == 0)
+		size = 1;
+	void* p = align == 0 ? std::malloc(size) : std::aligned_alloc(align, (size + align - 1) / align * align);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new(std::size_t size) { return counted_alloc(size); }
+void* operator new[](std::size_t size) { return counted_alloc(size); }
+void* operator new(std::size_t size, std::align_val_t align) { return counted_alloc(size, std::size_t(align)); }
+void* operator new[](std::size_t size, std::align_val_t align) { return counted_alloc(size, std::size_t(align)); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+
+static void print_allocations(CLI::StringView line, const CLI::AllocationStats& stats)
+{
+	constexpr const char* phases[] = { "other", "tokenize", "parse", "dispatch", "command", "pipeline-io" };
+	auto total = stats.total();
+	fmt::print("{:<32} {:>4} allocations {:>7} bytes", fmt::format("{:?}", line), total.count, total.bytes);
+	for (std::size_t i = 0; i < stats.phases.size(); i++)
+	{
+		if (stats.phases[i].count != 0)
+			fmt::print("  {}: {}/{}B", phases[i], stats.phases[i].count, stats.phases[i].bytes);
+	}
+	fmt::print("\n");
+}
+
+/**
+ * Run lines that must not allocate once they have been run a few times, i.e. once buffers of the
+ * session have grown and metrics of the commands exist. Returns the number of lines that did.
+**/
+int run_allocation_tests()
+{
+	CLI::CLI app;
+	app.insertCommand("noop", [](CLI::CLI&, const CLI::ArgList&) { return 0; });
+	app.insertCommand("fail", [](CLI::CLI&, const CLI::ArgList&) { return 1; });
+	app.insertCommand("emit", [](CLI::CLI& cli, const CLI::ArgList& args) {
+		for (std::size_t i = 1; i < args.size(); i++)
+			cli.print("{}\n", args[i]);
+		return 0;
+	});
+	app.insertCommand("drain", [](CLI::CLI& cli, const CLI::ArgList&) {
+		cli.get().ignore(std::numeric_limits<std::streamsize>::max());
+		return 0;
+	});
+	app.insertCommand("alloc", [](CLI::CLI&, const CLI::ArgList&) {
+		delete new int(0);
+		return 0;
+	});
+	CLI::Option<int>* typed_count = nullptr;
+	CLI::Option<CLI::String>* typed_name = nullptr;
+	app.insertCommand("typed", [&](CLI::CLI& cli, const CLI::ArgList&) {
+		return cli.argument(typed_count).get() == 3 && cli.argument(typed_name).get() == "x" ? 0 : 1;
+	});
+	typed_count = app.command("typed")->arguments().addOption<int>("count", 'n');
+	typed_name = app.command("typed")->arguments().addOption<CLI::String>("name");
+
+	// the hook must see allocations at all, or the checks below would pass trivially
+	app.runLine("alloc");
+	print_allocations("alloc", app.lineAllocations());
+	if (app.lineAllocations()[CLI::AllocationPhase::Command].count == 0)
+	{
+		fmt::print("FAILED: allocations are not counted\n");
+		return 1;
+	}
+
+	const char* steady_lines[] = {
+		"noop",
+		"noop with some arguments \"and a quoted one\"",
+		"noop && fail || noop",
+		"emit a b c | drain",
+		"emit a | emit b | drain",
+		"typed -n 3 --name x",
+	};
+	int failures = 0;
+	for (const char* line : steady_lines)
+	{
+		for (int i = 0; i < 3; i++)
+			app.runLine(line);
+		app.runLine(line);
+		const CLI::AllocationStats& stats = app.lineAllocations();
+		print_allocations(line, stats);
+		if (stats.total().count != 0)
+		{
+			fmt::print("FAILED: steady-state dispatch of {:?} allocates\n", line);
+			failures++;
+		}
+		if (CLI::StringView(line).starts_with("typed") && app.returnCode() != 0)
+		{
+			fmt::print("FAILED: arguments of {:?} aren't parsed\n", line);
+			failures++;
+		}
+	}
+	return failures;
+}
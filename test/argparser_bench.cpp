@@ -0,0 +1,253 @@
+#include "../include/CLI++/ArgumentParser.hpp"
+#include "../include/CLI++/ArgumentSchema.hpp"
+#include <getopt.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <iterator>
+
+SET_CLIPP_ALIAS(CLI);
+
+namespace {
+
+struct Parsed
+{
+	bool verbose = false;
+	bool quiet = false;
+	bool all = false;
+	int jobs = 1;
+	int level = 0;
+	CLI::String output;
+	CLI::String input;
+	int count = 0;
+
+	bool operator==(const Parsed&) const = default;
+};
+
+const char* bench_argv[] = {
+	"prog", "-vq", "-j", "8", "--output=out.txt", "--level", "3", "-a", "--", "input.txt", "42",
+};
+constexpr int bench_argc = int(std::size(bench_argv));
+
+Parsed parse_getopt(int argc, const char** argv)
+{
+	static const option long_options[] = {
+		{ "verbose", no_argument, nullptr, 'v' },
+		{ "quiet", no_argument, nullptr, 'q' },
+		{ "all", no_argument, nullptr, 'a' },
+		{ "jobs", required_argument, nullptr, 'j' },
+		{ "output", required_argument, nullptr, 'o' },
+		{ "level", required_argument, nullptr, 'l' + 256 },
+		{ nullptr, 0, nullptr, 0 },
+	};
+	Parsed parsed;
+	optind = 0;	// full reinitialization (GNU)
+	int c;
+	while ((c = getopt_long(argc, const_cast<char* const*>(argv), "+vqaj:o:", long_options, nullptr)) != -1)
+	{
+		switch (c)
+		{
+		case 'v': parsed.verbose = true; break;
+		case 'q': parsed.quiet = true; break;
+		case 'a': parsed.all = true; break;
+		case 'j': parsed.jobs = int(std::strtol(optarg, nullptr, 10)); break;
+		case 'o': parsed.output = optarg; break;
+		case 'l' + 256: parsed.level = int(std::strtol(optarg, nullptr, 10)); break;
+		default: std::abort();
+		}
+	}
+	if (optind < argc)
+		parsed.input = argv[optind++];
+	if (optind < argc)
+		parsed.count = int(std::strtol(argv[optind++], nullptr, 10));
+	return parsed;
+}
+
+constexpr CLI::ArgSchema parsed_schema{
+	CLI::flag(&Parsed::verbose, "verbose", 'v'),
+	CLI::flag(&Parsed::quiet, "quiet", 'q'),
+	CLI::flag(&Parsed::all, "all", 'a'),
+	CLI::option(&Parsed::jobs, "jobs", 'j'),
+	CLI::option(&Parsed::output, "output", 'o'),
+	CLI::option(&Parsed::level, "level"),
+	CLI::positional(&Parsed::input, "input").required(),
+	CLI::positional(&Parsed::count, "count"),
+};
+
+template<typename Func>
+double ns_per_call(int iterations, Func&& fn)
+{
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+		fn();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	return double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / iterations;
+}
+
+/**
+ * Parse `-v @file` where the file holds `paths` paths, all of them but the first read as extra
+ * positional arguments. Returns non-zero if a path is lost or changed.
+**/
+int run_response_file_bench(int paths)
+{
+	char path[] = "/tmp/clipp-response-XXXXXX";
+	int fd = ::mkstemp(path);
+	if (fd < 0)
+	{
+		fmt::print("FAILED: can't create a response file\n");
+		return 1;
+	}
+	std::FILE* file = ::fdopen(fd, "w");
+	auto path_at = [](int i) {
+		return i % 16 == 15 ? fmt::format("dir {}/file name.txt", i) : fmt::format("dir{}/file.txt", i);
+	};
+	for (int i = 0; i < paths; i++)
+		fmt::print(file, "{:?}\n", path_at(i));
+	std::fclose(file);
+
+	CLI::ArgParser parser;
+	parser.setResponseFiles();
+	parser.setExtraPositionals();
+	auto verbose = parser.addFlag("verbose", 'v');
+	auto first = parser.addPositional<CLI::String>("first");
+	CLI::String response = fmt::format("@{}", path);
+	const char* argv[] = { "prog", "-v", response.c_str() };
+
+	auto start = std::chrono::steady_clock::now();
+	parser.parse(3, argv);
+	int count = 1;
+	CLI::StringView last;
+	for (CLI::StringView arg : parser.extraPositionals())
+	{
+		last = arg;
+		count++;
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	bool ok = verbose->get() && first->get() == path_at(0) && count == paths && last == path_at(paths - 1);
+	::unlink(path);
+	if (!ok)
+	{
+		fmt::print("FAILED: {} of {} paths read from a response file, the last one is {:?}\n", count, paths, last);
+		return 1;
+	}
+	fmt::print("  response file {:>8.1f} ns/path ({} paths)\n",
+		double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / paths, paths);
+	return 0;
+}
+
+/**
+ * Parse a repeated option, one taking 2 values and a comma separated list of `count` numbers.
+ * Returns non-zero if a value is lost or changed.
+**/
+int run_multi_option_bench(int count)
+{
+	CLI::String list;
+	for (int i = 0; i < count; i++)
+		fmt::format_to(std::back_inserter(list), "{}{}", i == 0 ? "" : ",", i * 7 - 3);
+
+	CLI::ArgParser parser;
+	auto include = parser.addMultiOption<CLI::String>("include", 'I');
+	auto range = parser.addMultiOption<int>("range", '\0', 2);
+	auto ids = parser.addMultiOption<int>("ids")->setDelimiter(',');
+	const char* argv[] = { "prog", "-I", "a", "-Ib", "--range", "1", "-10", "--include=c", "--ids", list.c_str() };
+
+	auto start = std::chrono::steady_clock::now();
+	parser.parse(int(std::size(argv)), argv);
+	std::span<const int> values = ids->get();
+	auto elapsed = std::chrono::steady_clock::now() - start;
+
+	bool ok = std::ranges::equal(include->get(), std::array<CLI::StringView, 3>{ "a", "b", "c" })
+		&& std::ranges::equal(range->get(), std::array{ 1, -10 }) && int(values.size()) == count;
+	for (int i = 0; ok && i < count; i++)
+		ok = values[i] == i * 7 - 3;
+	if (!ok)
+	{
+		fmt::print("FAILED: values of repeated or multi-valued options are wrong\n");
+		return 1;
+	}
+	fmt::print("  number list   {:>8.1f} ns/value ({} values)\n",
+		double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()) / count, count);
+	return 0;
+}
+
+/**
+ * Parse `tool -v remote add -f origin url` with a tree of 64 subcommands of 32 options each, `iterations`
+ * times. Returns non-zero if the subcommands given aren't selected.
+**/
+int run_subcommand_bench(int iterations)
+{
+	CLI::ArgParser tool;
+	auto verbose = tool.addFlag("verbose", 'v');
+	for (int i = 0; i < 64; i++)
+	{
+		CLI::ArgParser* command = tool.addSubcommand(fmt::format("command{}", i));
+		for (int j = 0; j < 32; j++)
+			command->addOption<int>(fmt::format("option{}", j));
+	}
+	CLI::ArgParser* remote = tool.addSubcommand("remote");
+	CLI::ArgParser* add = remote->addSubcommand("add");
+	auto fetch = add->addFlag("fetch", 'f');
+	auto name = add->addPositional<CLI::String>("name");
+	auto url = add->addPositional<CLI::String>("url");
+	const char* argv[] = { "tool", "-v", "remote", "add", "-f", "origin", "https://example.com/repo.git" };
+
+	tool.parse(int(std::size(argv)), argv);
+	if (!verbose->get() || tool.selectedSubcommand() != remote || remote->selectedSubcommand() != add
+		|| !fetch->get() || name->get() != "origin" || url->get() != argv[6])
+	{
+		fmt::print("FAILED: subcommands given aren't selected\n");
+		return 1;
+	}
+	double ns = ns_per_call(iterations, [&]() { tool.parse(int(std::size(argv)), argv); });
+	fmt::print("  subcommands   {:>8.1f} ns/parse ({} subcommands)\n", ns, 65);
+	return 0;
+}
+
+} // namespace
+
+/**
+ * Parse the same arguments with `ArgParser`, `ArgSchema` and `getopt_long` `iterations` times each and print
+ * the time of a parse. Then time subcommands, a response file of `iterations * 100` paths (a million at
+ * most) and a list of as many numbers. Returns non-zero if a result is wrong.
+**/
+int run_argparser_bench(int iterations)
+{
+	CLI::ArgParser parser;
+	auto verbose = parser.addFlag("verbose", 'v');
+	auto quiet = parser.addFlag("quiet", 'q');
+	auto all = parser.addFlag("all", 'a');
+	auto jobs = parser.addOption<int>("jobs", 'j', 1);
+	auto output = parser.addOption<CLI::String>("output", 'o');
+	auto level = parser.addOption<int>("level");
+	auto input = parser.addPositional<CLI::String>("input")->setRequired(true);
+	auto count = parser.addPositional<int>("count");
+
+	auto parse_clipp = [&]() {
+		parser.parse(bench_argc, bench_argv);
+		return Parsed{ verbose->get(), quiet->get(), all->get(), jobs->get(), level->get(),
+			output->get(), input->get(), count->get() };
+	};
+
+	Parsed expected{ true, true, true, 8, 3, "out.txt", "input.txt", 42 };
+	if (parse_clipp() != expected || parsed_schema.parse(bench_argc, bench_argv) != expected
+		|| parse_getopt(bench_argc, bench_argv) != expected)
+	{
+		fmt::print("FAILED: parsers disagree on {}\n", fmt::join(bench_argv, " "));
+		return 1;
+	}
+
+	// values are converted when they are read, so reading them is part of a parse
+	double clipp_ns = ns_per_call(iterations, parse_clipp);
+	double unread_ns = ns_per_call(iterations, [&]() { parser.parse(bench_argc, bench_argv); });
+	double schema_ns = ns_per_call(iterations, [&]() { parsed_schema.parse(bench_argc, bench_argv); });
+	double getopt_ns = ns_per_call(iterations, [&]() { parse_getopt(bench_argc, bench_argv); });
+	fmt::print("{} ({} iterations)\n", fmt::join(bench_argv, " "), iterations);
+	fmt::print("  ArgParser    {:>8.1f} ns/parse ({:.1f} ns with values not read)\n", clipp_ns, unread_ns);
+	fmt::print("  ArgSchema    {:>8.1f} ns/parse\n", schema_ns);
+	fmt::print("  getopt_long  {:>8.1f} ns/parse\n", getopt_ns);
+	int paths = std::min(iterations, 10000) * 100;
+	return run_subcommand_bench(iterations) + run_response_file_bench(paths) + run_multi_option_bench(paths);
+}
@@ -0,0 +1,347 @@
+#include "../include/CLI++/CLI++.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <span>
+#include <vector>
+
+SET_CLIPP_ALIAS(CLI);
+
+/** @brief Count a failure of a check, `what` describes it. */
+static int expect(bool passed, const CLI::String& what)
+{
+	if (!passed)
+		fmt::print("FAILED: {}\n", what);
+	return passed ? 0 : 1;
+}
+
+/** @brief Call `run` and return the message of the `CLIException` it throws, empty if it doesn't. */
+template<typename Func>
+static CLI::String error_of(Func&& run)
+{
+	try
+	{
+		run();
+	}
+	catch (const CLI::CLIException& e)
+	{
+		return e.what();
+	}
+	return CLI::String();
+}
+
+struct ParseCheck
+{
+	std::vector<CLI::String> args;	// the program name is added in front
+	CLI::String error;	// message of the parse error, empty if the parse succeeds
+};
+
+/** @brief Parse the arguments of every check, return the number of them that didn't fail as expected. */
+static int run_parse_checks(CLI::ArgParser& parser, std::span<const ParseCheck> checks)
+{
+	int failures = 0;
+	for (const ParseCheck& check : checks)
+	{
+		std::vector<CLI::String> args{ "prog" };
+		args.insert(args.end(), check.args.begin(), check.args.end());
+		CLI::String error = error_of([&]() { parser.parse(args); });
+		failures += expect(error == check.error, fmt::format("parse of {} failed with {:?}, not {:?}",
+			fmt::join(check.args, " "), error, check.error));
+	}
+	return failures;
+}
+
+static int test_parse_errors()
+{
+	int failures = 0;
+	CLI::ArgParser parser;
+	auto* verbose = parser.addFlag("verbose", 'v');
+	auto* count = parser.addOption<int>("count", 'n', 1);
+	auto* input = parser.addPositional<CLI::String>("input", "none");
+	// values are views into the arguments until they are converted
+	std::vector<CLI::String> args;
+	const ParseCheck checks[] = {
+		{ { "-x" }, "unknown option \"-x\"" },
+		{ { "-vx" }, "unknown option \"-x\"" },
+		{ { "--nope" }, "unknown option \"--nope\"" },
+		{ { "--nope=1" }, "unknown option \"--nope\"" },
+		{ { "-n" }, "option -n requires a value" },
+		{ { "--count" }, "option --count requires a value" },
+		{ { "--verbose=1" }, "option --verbose doesn't take a value" },
+		{ { "a", "b" }, "unexpected argument \"b\"" },
+		{ { "--count=2", "-v", "a" }, "" },
+	};
+	failures += run_parse_checks(parser, checks);
+
+	args = { "prog", "-vn4", "in" };
+	parser.parse(args);
+	failures += expect(verbose->get() && count->get() == 4 && input->get() == "in", "bundled flag and value");
+	args = { "prog", "--count=3", "x" };
+	parser.parse(args);
+	failures += expect(count->get() == 3 && input->get() == "x", "--count=3");
+	// after `--` and for a lone `-`, arguments are positional
+	args = { "prog", "--", "-v" };
+	parser.parse(args);
+	failures += expect(!verbose->given() && input->get() == "-v", fmt::format("-- -v gives <input> {:?}", input->get()));
+	args = { "prog", "-" };
+	parser.parse(args);
+	failures += expect(input->get() == "-", fmt::format("- gives <input> {:?}", input->get()));
+
+	CLI::ArgParser required;
+	required.addOption<CLI::String>("key", 'k')->setRequired(true);
+	required.addPositional<CLI::String>("file")->setRequired(true);
+	const ParseCheck missing[] = {
+		{ {}, "missing required option --key" },
+		{ { "-k", "x" }, "missing required argument <file>" },
+		{ { "f" }, "missing required option --key" },
+		{ { "--key", "x", "f" }, "" },
+	};
+	failures += run_parse_checks(required, missing);
+	return failures;
+}
+
+static int test_value_conversion()
+{
+	int failures = 0;
+	CLI::ArgParser parser;
+	auto* count = parser.addOption<int>("count", 'n');
+	auto* size = parser.addOption<unsigned>("size", 's');
+	auto* ratio = parser.addOption<double>("ratio", 'r');
+	auto* enabled = parser.addPositional<bool>("enabled");
+	// values are converted by `get`, the whole argument has to be a value of the type
+	std::vector<CLI::String> args;
+	auto check = [&](std::vector<CLI::String> given, auto* opt, CLI::StringView error) {
+		args = std::move(given);
+		args.insert(args.begin(), "prog");
+		CLI::String got = error_of([&]() { parser.parse(args); opt->get(); });
+		failures += expect(got == error, fmt::format("{} failed with {:?}, not {:?}", fmt::join(args, " "), got, error));
+	};
+	check({ "-n", "12abc" }, count, "invalid value for --count: \"12abc\" is not a valid int");
+	check({ "-n", "" }, count, "invalid value for --count: \"\" is not a valid int");
+	check({ "-n", "99999999999" }, count, "invalid value for --count: \"99999999999\" is out of range of int");
+	check({ "-n", "+-7" }, count, "invalid value for --count: \"+-7\" is not a valid int");
+	check({ "-s", "-1" }, size, "invalid value for --size: \"-1\" is not a valid unsigned int");
+	check({ "-r", "1.5x" }, ratio, "invalid value for --ratio: \"1.5x\" is not a valid double");
+	check({ "yes" }, enabled, "invalid value for <enabled>: \"yes\" is not a valid bool, expecting true, false, 1 or 0");
+	check({ "True" }, enabled, "invalid value for <enabled>: \"True\" is not a valid bool, expecting true, false, 1 or 0");
+
+	args = { "prog", "-n", "+7", "-s", "4294967295", "-r", "-1.5e3", "1" };
+	parser.parse(args);
+	failures += expect(count->get() == 7 && size->get() == 4294967295u && ratio->get() == -1500.0 && enabled->get(),
+		"valid numbers and bool");
+	args = { "prog", "--count=-2147483648", "false" };
+	parser.parse(args);
+	failures += expect(count->get() == -2147483648 && !enabled->get(), "smallest int and false");
+	for (const char* text : { "true", "1" })
+	{
+		args = { "prog", text };
+		parser.parse(args);
+		failures += expect(enabled->get(), fmt::format("{:?} is true", text));
+	}
+	args = { "prog", "0" };
+	parser.parse(args);
+	failures += expect(!enabled->get(), "\"0\" is false");
+	return failures;
+}
+
+static int test_parse_defaults()
+{
+	int failures = 0;
+	CLI::ArgParser parser;
+	auto* count = parser.addOption<int>("count", 'n', 5);
+	auto* verbose = parser.addFlag("verbose", 'v');
+	auto* tags = parser.addMultiOption<CLI::String>("tag", 't');
+	auto* name = parser.addPositional<CLI::String>("name", "anon");
+	std::vector<CLI::String> given = { "prog", "-n", "7", "-v", "-t", "a", "-t", "b", "bob" };
+	std::vector<CLI::String> none = { "prog" };
+	std::vector<CLI::String> invalid = { "prog", "-n", "x" };
+	auto defaults = [&]() {
+		return count->get() == 5 && !verbose->get() && tags->get().empty() && name->get() == "anon";
+	};
+
+	// whether the values of a parse are read or not, the next one starts from the defaults
+	parser.parse(given);
+	parser.parse(none);
+	failures += expect(defaults(), "values of a parse that weren't read are kept by the next one");
+	parser.parse(given);
+	failures += expect(count->get() == 7 && verbose->get() && tags->get().size() == 2 && name->get() == "bob",
+		"values given");
+	parser.parse(none);
+	failures += expect(defaults(), "values of a parse that were read are kept by the next one");
+	// an invalid value that isn't read is dropped too
+	parser.parse(invalid);
+	CLI::String error = error_of([&]() { parser.parse(none); count->get(); });
+	failures += expect(error.empty() && defaults(), fmt::format("invalid value left unread fails the next parse with {:?}", error));
+	return failures;
+}
+
+static int test_lazy_conversion()
+{
+	int failures = 0;
+	CLI::ArgParser parser;
+	auto* count = parser.addOption<int>("count", 'n', 1);
+	auto* level = parser.addPositional<int>("level");
+	std::vector<CLI::String> args = { "prog", "-n", "x", "3" };
+	const CLI::String invalid = "invalid value for --count: \"x\" is not a valid int";
+
+	// an invalid value fails its `get`, again until the next parse, not the parse itself
+	CLI::String error = error_of([&]() { parser.parse(args); });
+	failures += expect(error.empty(), fmt::format("lazy parse failed with {:?}", error));
+	failures += expect(level->get() == 3, "valid value next to an invalid one");
+	for (int i = 0; i < 2; i++)
+	{
+		error = error_of([&]() { count->get(); });
+		failures += expect(error == invalid, fmt::format("get of an invalid value failed with {:?}", error));
+	}
+	error = error_of([&]() { parser.validate(); });
+	failures += expect(error == invalid, fmt::format("validate failed with {:?}", error));
+
+	// eager conversion fails the parse
+	parser.setEager();
+	error = error_of([&]() { parser.parse(args); });
+	failures += expect(error == invalid, fmt::format("eager parse failed with {:?}", error));
+	args = { "prog", "-n", "2", "high" };
+	error = error_of([&]() { parser.parse(args); });
+	failures += expect(error == "invalid value for <level>: \"high\" is not a valid int",
+		fmt::format("eager parse of a positional argument failed with {:?}", error));
+	args = { "prog", "-n", "2", "4" };
+	error = error_of([&]() { parser.parse(args); });
+	failures += expect(error.empty() && count->get() == 2 && level->get() == 4, fmt::format("eager parse failed with {:?}", error));
+	return failures;
+}
+
+static int test_response_files()
+{
+	int failures = 0;
+	char dir[] = "/tmp/clipp-response-XXXXXX";
+	if (::mkdtemp(dir) == nullptr)
+		return expect(false, "can't create a temporary directory");
+	auto write_file = [&](CLI::StringView name, CLI::StringView text) {
+		CLI::String path = fmt::format("{}/{}", dir, name);
+		std::FILE* file = std::fopen(path.c_str(), "w");
+		fmt::print(file, "{}", text);
+		std::fclose(file);
+		return path;
+	};
+	CLI::String words = write_file("words", "-v \"two words\"\n'it''s' three");
+	CLI::String unbalanced = write_file("unbalanced", "-v \"no end");
+	CLI::String missing = fmt::format("{}/missing", dir);
+
+	CLI::ArgParser parser;
+	parser.setResponseFiles();
+	parser.setExtraPositionals();
+	auto* verbose = parser.addFlag("verbose", 'v');
+	auto* first = parser.addPositional<CLI::String>("first");
+	std::vector<CLI::String> args = { "prog", fmt::format("@{}", words), "last" };
+	parser.parse(args);
+	std::vector<CLI::String> extra;
+	for (CLI::StringView arg : parser.extraPositionals())
+		extra.emplace_back(arg);
+	failures += expect(verbose->get() && first->get() == "two words" && extra == std::vector<CLI::String>{ "its", "three", "last" },
+		fmt::format("response file gives {:?} and {}", first->get(), fmt::join(extra, ", ")));
+
+	args = { "prog", fmt::format("@{}", unbalanced) };
+	CLI::String error = error_of([&]() { parser.parse(args); });
+	failures += expect(error == fmt::format("response file {}: unbalanced quote \"", unbalanced),
+		fmt::format("unbalanced quote failed with {:?}", error));
+	args = { "prog", fmt::format("@{}", missing) };
+	error = error_of([&]() { parser.parse(args); });
+	failures += expect(error == fmt::format("can't read response file {}: No such file or directory", missing),
+		fmt::format("missing response file failed with {:?}", error));
+	// without response files, @ is a plain argument
+	parser.setResponseFiles(false);
+	parser.parse(args);
+	failures += expect(first->get() == args[1], fmt::format("@ without response files gives {:?}", first->get()));
+	std::filesystem::remove_all(dir);
+	return failures;
+}
+
+static int test_multi_options()
+{
+	int failures = 0;
+	CLI::ArgParser parser;
+	auto* include = parser.addMultiOption<CLI::String>("include", 'I');
+	auto* range = parser.addMultiOption<int>("range", 'r', 2);
+	auto* ids = parser.addMultiOption<int>("ids")->setDelimiter(',');
+	auto* names = parser.addMultiOption<CLI::String>("names")->setDelimiter(',');
+	std::vector<CLI::String> args = { "prog", "-I", "a", "-Ib", "--include=c", "-r", "1", "-2", "--range", "3", "4",
+		"--ids", "5,6", "--ids=7", "--names", "x,,y" };
+	parser.parse(args);
+	failures += expect(std::ranges::equal(include->get(), std::vector<CLI::String>{ "a", "b", "c" })
+		&& std::ranges::equal(range->get(), std::vector{ 1, -2, 3, 4 }) && std::ranges::equal(ids->get(), std::vector{ 5, 6, 7 })
+		&& std::ranges::equal(names->get(), std::vector<CLI::String>{ "x", "", "y" }), "values of repeated options");
+
+	auto check = [&](std::vector<CLI::String> given, auto* opt, CLI::StringView error) {
+		args = std::move(given);
+		args.insert(args.begin(), "prog");
+		CLI::String got = error_of([&]() { parser.parse(args); opt->get(); });
+		failures += expect(got == error, fmt::format("{} failed with {:?}, not {:?}", fmt::join(args, " "), got, error));
+	};
+	check({ "-r", "1" }, range, "option -r requires 2 values");
+	check({ "--range", "1" }, range, "option --range requires 2 values");
+	check({ "--range=1" }, range, "option --range requires 2 values");
+	check({ "-r" }, range, "option -r requires 2 values");
+	check({ "-r", "1", "x" }, range, "invalid value for --range: \"x\" is not a valid int");
+	check({ "--ids", "1,,3" }, ids, "invalid value for --ids: \"\" is not a valid int");
+	check({ "--ids", "1," }, ids, "invalid value for --ids: \"\" is not a valid int");
+	check({ "--ids", "" }, ids, "invalid value for --ids: \"\" is not a valid int");
+	check({ "-I" }, include, "option -I requires a value");
+	return failures;
+}
+
+static int test_subcommands()
+{
+	int failures = 0;
+	CLI::ArgParser tool;
+	auto* verbose = tool.addFlag("verbose", 'v');
+	CLI::ArgParser* remote = tool.addSubcommand("remote");
+	CLI::ArgParser* add = remote->addSubcommand("add");
+	auto* fetch = add->addFlag("fetch", 'f');
+	auto* name = add->addPositional<CLI::String>("name")->setRequired(true);
+	CLI::ArgParser* log = tool.addSubcommand("log");
+	auto* count = log->addOption<int>("count", 'n', 10);
+	const ParseCheck checks[] = {
+		{ { "pull" }, "unknown command \"pull\"" },
+		{ { "remote", "rm" }, "unknown command \"rm\"" },
+		{ { "remote", "add" }, "missing required argument <name>" },
+		// options after a subcommand are its own
+		{ { "log", "-v" }, "unknown option \"-v\"" },
+		{ { "-n", "3", "log" }, "unknown option \"-n\"" },
+		{ { "log", "-n" }, "option -n requires a value" },
+	};
+	failures += run_parse_checks(tool, checks);
+
+	std::vector<CLI::String> args = { "tool", "-v", "remote", "add", "-f", "origin" };
+	tool.parse(args);
+	failures += expect(verbose->get() && tool.selectedSubcommand() == remote && remote->selectedSubcommand() == add
+		&& fetch->get() && name->get() == "origin", "nested subcommands selected");
+	// a subcommand that isn't selected keeps what its last parse set, the one selected is reset
+	std::vector<CLI::String> log_args = { "tool", "log", "-n", "3" };
+	tool.parse(log_args);
+	failures += expect(!verbose->get() && tool.selectedSubcommand() == log && count->get() == 3
+		&& fetch->get() && name->get() == "origin", "values of a subcommand that isn't selected");
+	args = { "tool", "log" };
+	tool.parse(args);
+	failures += expect(count->get() == 10, fmt::format("subcommand selected again has --count {}", count->get()));
+	args = { "tool" };
+	tool.parse(args);
+	failures += expect(tool.selectedSubcommand() == nullptr, "no subcommand selected");
+	return failures;
+}
+
+/** @brief Parse arguments and compare the errors with the messages expected. */
+int run_argparser_tests()
+{
+	int failures = 0;
+	failures += test_parse_errors();
+	failures += test_value_conversion();
+	failures += test_parse_defaults();
+	failures += test_lazy_conversion();
+	failures += test_response_files();
+	failures += test_multi_options();
+	failures += test_subcommands();
+	if (failures == 0)
+		fmt::print("all argument parser tests passed\n");
+	return failures;
+}
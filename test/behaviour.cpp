@@ -0,0 +1,765 @@
+#include "../include/CLI++/CLI++.hpp"
+#include "../include/CLI++/Server.hpp"
+#include <algorithm>
+#include <cctype>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <map>
+#include <span>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+SET_CLIPP_ALIAS(CLI);
+
+/** @brief Call `run` and return what it wrote to `fd`, output of external programs included. */
+template<typename Func>
+static CLI::String captured(int fd, Func&& run)
+{
+	std::fflush(stdout);
+	std::fflush(stderr);
+	std::FILE* file = std::tmpfile();
+	int saved = ::dup(fd);
+	::dup2(::fileno(file), fd);
+	run();
+	std::fflush(stdout);
+	std::fflush(stderr);
+	::dup2(saved, fd);
+	::close(saved);
+
+	CLI::String output;
+	std::rewind(file);
+	char buffer[4096];
+	while (std::size_t n = std::fread(buffer, 1, sizeof(buffer), file))
+		output.append(buffer, n);
+	std::fclose(file);
+	return output;
+}
+
+/** @brief Directory removed with its contents when it goes out of scope. */
+struct TempDir
+{
+	TempDir()
+	{
+		char name[] = "/tmp/clipp-test-XXXXXX";
+		if (::mkdtemp(name) == nullptr)
+			throw std::runtime_error("can't create a temporary directory");
+		path = name;
+	}
+	~TempDir() { std::filesystem::remove_all(path); }
+	CLI::String operator/(CLI::StringView file) const { return path + '/' + CLI::String(file); }
+
+	CLI::String path;
+};
+
+/** @brief Return code of a check that isn't compared, e.g. for lines failing with an error. */
+constexpr int any_code = -1;
+
+struct Check
+{
+	CLI::String line;
+	CLI::String output;
+	int return_code = 0;
+	bool partial = false;	// output or stderr only has to contain `output`, e.g. an error message
+};
+
+/** @brief Run every line in order, return the number of them that didn't print or return what's expected. */
+static int run_checks(CLI::CLI& app, std::span<const Check> checks)
+{
+	int failures = 0;
+	for (const Check& check : checks)
+	{
+		// errors are expected from some lines, they are only shown if the check fails
+		CLI::String output;
+		CLI::String errors = captured(STDERR_FILENO, [&]() {
+			output = captured(STDOUT_FILENO, [&]() { app.runLine(check.line); });
+		});
+		bool printed = check.partial
+			? output.find(check.output) != CLI::String::npos || errors.find(check.output) != CLI::String::npos
+			: output == check.output;
+		if (printed && (check.return_code == any_code || app.returnCode() == check.return_code))
+			continue;
+		fmt::print("FAILED: {:?}\n  expected {:?} = {}\n  got      {:?} = {}\n  stderr   {:?}\n", check.line,
+			check.output, check.return_code, output, app.returnCode(), errors);
+		failures++;
+	}
+	return failures;
+}
+
+/** @brief Count a failure of a check that isn't a line, `what` describes it. */
+static int expect(bool passed, const CLI::String& what)
+{
+	if (!passed)
+		fmt::print("FAILED: {}\n", what);
+	return passed ? 0 : 1;
+}
+
+/** @brief Commands the tests run: `emit` prints its arguments, `upper` and `count` read their input. */
+static void add_commands(CLI::CLI& app)
+{
+	app.insertCommand("emit", [](CLI::CLI& cli, const CLI::ArgList& args) {
+		for (std::size_t i = 1; i < args.size(); i++)
+			cli.print("{}\n", args[i]);
+		return 0;
+	});
+	app.insertCommand("upper", [](CLI::CLI& cli, const CLI::ArgList&) {
+		CLI::String line;
+		while (cli.getline(line))
+		{
+			std::ranges::transform(line, line.begin(), [](char c) { return char(std::toupper(c)); });
+			cli.print("{}\n", line);
+		}
+		return 0;
+	});
+	app.insertCommand("count", [](CLI::CLI& cli, const CLI::ArgList&) {
+		CLI::String line;
+		int lines = 0;
+		while (cli.getline(line))
+			lines++;
+		cli.print("{}\n", lines);
+		return 0;
+	});
+	app.insertCommand("fail", [](CLI::CLI&, const CLI::ArgList&) { return 1; });
+}
+
+static int test_external_stages()
+{
+	CLI::CLI app;
+	add_commands(app);
+	const Check checks[] = {
+		{ "!echo hi", "hi\n" },
+		{ "!false", "", 1 },
+		{ "emit b a c | !sort", "a\nb\nc\n" },
+		{ "!printf 'x\\ny\\n' | count", "2\n" },
+		{ "emit a b | !tr a-z A-Z | !sort -r | count", "2\n" },
+		{ "!printf 'q\\n' | !cat | upper", "Q\n" },
+		{ "!true && emit yes", "yes\n" },
+		{ "!no-such-program-here || emit fallback", "fallback\n" },
+	};
+	return run_checks(app, checks);
+}
+
+static int test_redirections()
+{
+	CLI::CLI app;
+	add_commands(app);
+	TempDir dir;
+	CLI::String file = dir / "out.txt";
+	CLI::String missing = dir / "missing.txt";
+	const Check checks[] = {
+		{ fmt::format("emit a b > {}", file), "" },
+		{ fmt::format("count < {}", file), "2\n" },
+		{ fmt::format("emit c >> {}", file), "" },
+		{ fmt::format("upper < {}", file), "A\nB\nC\n" },
+		// `>` truncates what's there
+		{ fmt::format("emit d > {}", file), "" },
+		{ fmt::format("upper < {} | count", file), "1\n" },
+		{ fmt::format("upper < {} > {}", file, dir / "copy.txt"), "" },
+		{ fmt::format("!cat {}", dir / "copy.txt"), "D\n" },
+		{ fmt::format("!cat < {} | upper", file), "D\n" },
+		{ fmt::format("emit e | !cat >> {}", file), "" },
+		{ fmt::format("count < {}", file), "2\n" },
+		{ fmt::format("count < {}", missing), missing, any_code, true },
+		{ "emit x >", "missing file name after \">\"", any_code, true },
+	};
+	return run_checks(app, checks);
+}
+
+static int test_jobs()
+{
+	CLI::CLI app;
+	add_commands(app);
+	// ids start from 1 again once every job has been waited for
+	const Check checks[] = {
+		{ "emit a b &", "[1]\n" },
+		{ "wait 1", "a\nb\n" },
+		{ "emit x | upper &", "[1]\n" },
+		{ "fail &", "[2]\n" },
+		{ "wait 1", "X\n" },
+		{ "wait 2", "", 1 },
+		{ "!sleep 30 &", "[1]\n" },
+		{ "jobs", "!sleep 30 &\n", 0, true },
+		{ "kill 1", "" },
+		{ "wait", "", 128 + SIGTERM },
+		{ "jobs", "" },
+		{ "wait 7", "", 127 },
+		{ "kill 7", "", 1 },
+		{ "&", "unexpected operator \"&\"", any_code, true },
+	};
+	return run_checks(app, checks);
+}
+
+static int test_fan_out()
+{
+	CLI::CLI app;
+	add_commands(app);
+	// outputs of the branches are written in the order of the branches
+	const Check checks[] = {
+		{ "emit a b |> (upper, count)", "A\nB\n2\n" },
+		{ "emit a b |> (upper | count, emit z, upper)", "2\nz\nA\nB\n" },
+		{ "emit a b |> (upper, upper) | count", "unexpected \"|\" after a fan-out group", any_code, true },
+		{ "emit a |> (fail, emit b)", "b\n", 1 },
+		{ "emit a |> (emit b, fail)", "b\n", 1 },
+		{ "emit a |> (upper) && emit done", "A\ndone\n" },
+		{ "!printf 'x\\ny\\n' |> (count, !cat)", "2\nx\ny\n" },
+		{ "emit a |> upper", "expected \"(\" after \"|>\"", any_code, true },
+		{ "emit a |> (upper", "missing \")\"", any_code, true },
+	};
+	return run_checks(app, checks);
+}
+
+static int test_pmap()
+{
+	CLI::CLI app;
+	add_commands(app);
+	const Check checks[] = {
+		{ "emit a b c d | pmap -k -j 4 upper", "A\nB\nC\nD\n" },
+		{ "emit a b c d e | pmap -k -n 2 count", "2\n2\n1\n" },
+		{ "emit a b c | pmap -j 2 count | count", "3\n" },
+		// workers of the inner calls come from the pool busy running the outer one
+		{ "emit a b c d e f g h | pmap -k -j 64 pmap -j 64 upper", "A\nB\nC\nD\nE\nF\nG\nH\n" },
+		{ "emit a b | pmap fail", "", 1 },
+		{ "emit a | pmap -j x upper", "", 2 },
+		{ "emit a | pmap nothing", "", 2 },
+		{ "pmap", "", 2 },
+	};
+	return run_checks(app, checks);
+}
+
+static int test_line_sources()
+{
+	int failures = 0;
+	{
+		// lines after `exit` aren't read
+		CLI::CLI app;
+		add_commands(app);
+		const char* lines[] = { "emit a", "emit b | upper", "", "exit 3", "emit never" };
+		app.setLineSource(std::make_unique<CLI::QueueLineSource>(lines));
+		int code = 0;
+		CLI::String output = captured(STDOUT_FILENO, [&]() { code = app.exec(); });
+		failures += expect(output == "a\nB\n" && code == 3, fmt::format("queued lines printed {:?} = {}", output, code));
+	}
+	{
+		CLI::CLI app;
+		add_commands(app);
+		auto source = std::make_unique<CLI::QueueLineSource>();
+		CLI::QueueLineSource* queue = source.get();
+		app.setLineSource(std::move(source));
+		std::thread producer([queue]() {
+			for (int i = 0; i < 3; i++)
+				queue->push(fmt::format("emit {}", i));
+			queue->close();
+		});
+		CLI::String output = captured(STDOUT_FILENO, [&]() { app.exec(); });
+		producer.join();
+		failures += expect(output == "0\n1\n2\n", fmt::format("lines pushed by another thread printed {:?}", output));
+	}
+	{
+		// the last line doesn't need a newline
+		CLI::CLI app;
+		add_commands(app);
+		int fds[2];
+		if (::pipe(fds) != 0)
+			return failures + expect(false, "pipe");
+		const char text[] = "emit x\n\nemit y | count\nemit z";
+		bool written = ::write(fds[1], text, sizeof(text) - 1) == ssize_t(sizeof(text) - 1);
+		::close(fds[1]);
+		app.setLineSource(std::make_unique<CLI::FdLineSource>(fds[0], true));
+		CLI::String output = captured(STDOUT_FILENO, [&]() { app.exec(); });
+		failures += expect(written && output == "x\n1\nz\n", fmt::format("lines read from a pipe printed {:?}", output));
+	}
+	return failures;
+}
+
+static int test_sessions()
+{
+	int failures = 0;
+	CLI::CLI app;
+	add_commands(app);
+	std::shared_ptr<const CLI::CommandRegistry> commands = app.shareCommands();
+	try
+	{
+		app.insertCommand("late", [](CLI::CLI&, const CLI::ArgList&) { return 0; });
+		failures += expect(false, "commands were inserted once shared");
+	}
+	catch (const CLI::CLIException&) {}
+
+	// every session runs its own lines on its own thread, into a file of its own
+	constexpr int sessions = 4, lines = 50;
+	TempDir dir;
+	std::vector<int> codes(sessions);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < sessions; i++)
+	{
+		threads.emplace_back([&, i]() {
+			CLI::CLI session(commands);
+			CLI::String file = dir / fmt::format("{}.txt", i);
+			for (int n = 0; n < lines; n++)
+				session.runLine(fmt::format("emit {}-{} | upper >> {}", i, n, file));
+			session.runLine(i % 2 ? "fail" : "emit ok > /dev/null");
+			codes[i] = session.returnCode();
+		});
+	}
+	for (std::thread& thread : threads)
+		thread.join();
+	for (int i = 0; i < sessions; i++)
+	{
+		CLI::CLI reader(commands);
+		CLI::String output = captured(STDOUT_FILENO, [&]() {
+			reader.runLine(fmt::format("count < {}", dir / fmt::format("{}.txt", i)));
+		});
+		failures += expect(output == fmt::format("{}\n", lines), fmt::format("session {} wrote {:?} lines", i, output));
+		failures += expect(codes[i] == i % 2, fmt::format("session {} returned {}", i, codes[i]));
+	}
+	return failures;
+}
+
+/** @brief Connect to a Unix domain socket, -1 on failure. */
+static int connect_unix(const CLI::String& path)
+{
+	sockaddr_un address{};
+	address.sun_family = AF_UNIX;
+	path.copy(address.sun_path, sizeof(address.sun_path) - 1);
+	int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		::close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/** @brief Read from `fd` until what's read ends with `end`, the peer hangs up or nothing comes for 5 seconds. */
+static CLI::String read_until(int fd, CLI::StringView end)
+{
+	CLI::String received;
+	char buffer[4096];
+	pollfd event{ fd, POLLIN, 0 };
+	while (!CLI::StringView(received).ends_with(end) && ::poll(&event, 1, 5000) > 0)
+	{
+		ssize_t n = ::read(fd, buffer, sizeof(buffer));
+		if (n <= 0)
+			break;
+		received.append(buffer, std::size_t(n));
+	}
+	return received;
+}
+
+static bool send_text(int fd, CLI::StringView text)
+{
+	return ::send(fd, text.data(), text.size(), MSG_NOSIGNAL) == ssize_t(text.size());
+}
+
+static int test_server()
+{
+	int failures = 0;
+	CLI::CLI app;
+	add_commands(app);
+	TempDir dir;
+	CLI::String socket_path = dir / "cli.sock";
+	CLI::CLIServer server(app.shareCommands(), 4);
+	server.listenUnix(socket_path);
+	std::thread loop([&server]() { server.run(); });
+
+	// a client hanging up while its line runs doesn't disturb the others
+	int gone = connect_unix(socket_path);
+	failures += expect(gone >= 0 && send_text(gone, "!sleep 0.3\n"), "first client connects");
+	::close(gone);
+
+	int clients[3];
+	for (int& fd : clients)
+		fd = connect_unix(socket_path);
+	for (int i = 0; i < 3; i++)
+	{
+		bool sent = clients[i] >= 0 && send_text(clients[i], fmt::format("emit {} | upper\nemit a b |> (count, upper)\n", char('x' + i)));
+		CLI::String expected = fmt::format("{}\n2\nA\nB\n", char('X' + i));
+		CLI::String received = sent ? read_until(clients[i], expected) : CLI::String();
+		failures += expect(received == expected, fmt::format("client {} received {:?}", i, received));
+	}
+	// lines may arrive in pieces
+	bool sent = send_text(clients[0], "emit spl") && send_text(clients[0], "it\nemit done\n");
+	CLI::String received = sent ? read_until(clients[0], "done\n") : CLI::String();
+	failures += expect(received == "split\ndone\n", fmt::format("split line received {:?}", received));
+	// errors of a line go to the client that sent it
+	received = send_text(clients[2], "nothing-here\n") ? read_until(clients[2], "unrecognized command: nothing-here\n") : CLI::String();
+	failures += expect(received.find("Error:") != CLI::String::npos && received.ends_with("unrecognized command: nothing-here\n"),
+		fmt::format("unknown command received {:?}", received));
+	// `exit` ends the session, the server closes the connection
+	received = send_text(clients[1], "exit\nemit never\n") ? read_until(clients[1], "\xff") : CLI::String();
+	failures += expect(received.empty(), fmt::format("lines after exit received {:?}", received));
+
+	for (int fd : clients)
+		::close(fd);
+	server.stop();
+	loop.join();
+	return failures;
+}
+
+static int test_history()
+{
+	int failures = 0;
+	TempDir dir;
+	CLI::String path = dir / "history";
+	{
+		// lines run by `exec` are added, a repeated line is kept at its latest position
+		CLI::CLI app;
+		add_commands(app);
+		app.setHistory(std::make_shared<CLI::History>(path));
+		const char* lines[] = { "emit one", "emit two | upper", "emit one", "fail" };
+		app.setLineSource(std::make_unique<CLI::QueueLineSource>(lines));
+		captured(STDOUT_FILENO, [&]() { app.exec(); });
+		const Check checks[] = {
+			{ "history", "     2  emit two | upper\n     3  emit one\n     4  fail\n" },
+			{ "history -n 1", "     4  fail\n" },
+			{ "history upper", "     2  emit two | upper\n" },
+			{ "history on", "     3  emit one\n" },
+			{ "history -n x", "", 2 },
+		};
+		failures += run_checks(app, checks);
+	}
+
+	// entries are read back from the file, searches go through the index
+	CLI::History history(path);
+	history.add("emit three");
+	history.add("bad\nline");
+	CLI::History::EntryId last = history.size() - 1;
+	failures += expect(history.size() == 5 && history.entry(0).empty() && history.entry(last) == "emit three",
+		fmt::format("history reopened has {} entries", history.size()));
+	failures += expect(history.search("emit") == last && history.search("emit", last) == 2
+		&& history.search("two") == 1 && history.search("missing") == CLI::History::npos, "history search");
+	failures += expect(history.complete("emit t") == "emit three" && history.complete("emit one") == std::nullopt
+		&& history.complete("") == std::nullopt, "history completion");
+	return failures;
+}
+
+static int test_suggestions()
+{
+	int failures = 0;
+	auto model = std::make_shared<CLI::SuggestionModel>();
+	model->learn("git commit -m fix");
+	model->learn("git commit -m fix");
+	model->learn("git checkout main");
+	model->learn("ls -la");
+	auto check = [&](CLI::StringView prefix, CLI::StringView expected) {
+		CLI::String suggested = model->suggest(prefix);
+		failures += expect(suggested == expected, fmt::format("{:?} suggests {:?}, not {:?}", prefix, suggested, expected));
+	};
+	// the most frequent words win, the last word is completed first
+	check("git", " commit -m fix");
+	check("git c", "ommit -m fix");
+	check("git checkout ", "main");
+	check("l", "s -la");
+	check("make", "");
+	check("", "");
+
+	// lines the model can't complete come from the history
+	TempDir dir;
+	CLI::CLI app;
+	app.setHistory(std::make_shared<CLI::History>(dir / "history"));
+	app.commandHistory()->add("echo \"a quoted line\"");
+	failures += expect(app.suggestion("echo") == "", "no suggestion without a model");
+	app.setSuggestions(model);
+	failures += expect(app.suggestion("git c") == "ommit -m fix", "suggestion of the model");
+	failures += expect(app.suggestion("echo \"a q") == "uoted line\"",
+		fmt::format("suggestion from the history is {:?}", app.suggestion("echo \"a q")));
+
+	// an empty model learns the history when `exec` starts
+	auto fresh = std::make_shared<CLI::SuggestionModel>();
+	app.setSuggestions(fresh);
+	app.setLineSource(std::make_unique<CLI::QueueLineSource>(std::vector<CLI::String>()));
+	app.exec();
+	failures += expect(fresh->size() == 1 && fresh->suggest("ech") == "o \"a quoted line\"", fmt::format("model learnt {} lines, suggests {:?}", fresh->size(), fresh->suggest("ech")));
+	return failures;
+}
+
+static int test_metrics()
+{
+	int failures = 0;
+	CLI::CLI app;
+	add_commands(app);
+	captured(STDOUT_FILENO, [&]() {
+		for (int i = 0; i < 3; i++)
+			app.runLine("emit a b | upper");
+		app.runLine("fail || fail");
+	});
+
+	struct Counted
+	{
+		std::uint64_t calls, succeeded, read, written, timed;
+	};
+	std::map<CLI::String, Counted, std::less<>> counted;
+	app.metrics()->forEach([&](CLI::StringView name, const CLI::CommandMetrics& m) {
+		counted.emplace(name, Counted{ m.invocations, m.return_codes[0], m.bytes_read, m.bytes_written, m.wall_time.count() });
+	});
+	auto check = [&](CLI::StringView name, Counted expected) {
+		auto it = counted.find(name);
+		bool same = it != counted.end() && it->second.calls == expected.calls && it->second.succeeded == expected.succeeded
+			&& it->second.read == expected.read && it->second.written == expected.written && it->second.timed == expected.timed;
+		failures += expect(same, fmt::format("metrics of {}", name));
+	};
+	// `emit` writes "a\nb\n" to the pipe `upper` reads, `upper` prints to stdout
+	check("emit", { 3, 3, 0, 12, 3 });
+	check("upper", { 3, 3, 12, 0, 3 });
+	check("fail", { 2, 0, 0, 0, 2 });
+
+	const Check checks[] = {
+		{ "stats emit | count", "2\n" },
+		{ "stats fail | upper", "FAIL                2        2", 0, true },
+		{ "stats -r > /dev/null", "" },
+	};
+	failures += run_checks(app, checks);
+	failures += expect(app.metrics()->command("emit").invocations == 0, "metrics were reset");
+
+	app.setMetrics(nullptr);
+	const Check disabled[] = {
+		{ "emit a", "a\n" },
+		{ "stats", "", 1 },
+	};
+	failures += run_checks(app, disabled);
+	return failures;
+}
+
+#if CLIPP_ENABLE_TRACING
+static int test_tracing()
+{
+	int failures = 0;
+	CLI::CLI app;
+	add_commands(app);
+	std::vector<CLI::String> events;
+	app.addTraceHook([&events](const CLI::CLI&, const CLI::TraceEvent& event) {
+		constexpr const char* kinds[] = { "parse", "pipeline", "command" };
+		bool begin = event.phase == CLI::TraceEvent::Phase::Begin;
+		events.push_back(fmt::format("{} {} {}.{} {}{}", begin ? '>' : '<', kinds[int(event.kind)],
+			event.pipeline, event.stage, event.name, begin ? CLI::String() : fmt::format(" = {}", event.return_code)));
+	});
+	auto check = [&](const CLI::String& line, std::span<const char* const> expected) {
+		events.clear();
+		captured(STDOUT_FILENO, [&]() { app.runLine(line); });
+		bool same = std::ranges::equal(events, expected, [](const CLI::String& a, const char* b) { return a == b; });
+		failures += expect(same, fmt::format("events of {:?} are\n  {}", line, fmt::join(events, "\n  ")));
+	};
+
+	const char* const piped[] = {
+		"> parse 0.0 emit a | upper && fail || emit b",
+		"< parse 0.0 emit a | upper && fail || emit b = 0",
+		"> pipeline 0.0 emit",
+		"> command 0.0 emit",
+		"< command 0.0 emit = 0",
+		"> command 0.1 upper",
+		"< command 0.1 upper = 0",
+		"< pipeline 0.0 emit = 0",
+		"> pipeline 1.0 fail",
+		"> command 1.0 fail",
+		"< command 1.0 fail = 1",
+		"< pipeline 1.0 fail = 1",
+		"> pipeline 2.0 emit",
+		"> command 2.0 emit",
+		"< command 2.0 emit = 0",
+		"< pipeline 2.0 emit = 0",
+	};
+	check("emit a | upper && fail || emit b", piped);
+	// consecutive external programs are a single stage
+	const char* const external[] = {
+		"> parse 0.0 !true | !cat | count",
+		"< parse 0.0 !true | !cat | count = 0",
+		"> pipeline 0.0 !true",
+		"> command 0.0 !true",
+		"< command 0.0 !true = 0",
+		"> command 0.1 count",
+		"< command 0.1 count = 0",
+		"< pipeline 0.0 !true = 0",
+	};
+	check("!true | !cat | count", external);
+
+	app.clearTraceHooks();
+	check("emit a", {});
+	return failures;
+}
+#endif
+
+static int test_timing()
+{
+	int failures = 0;
+	CLI::CLI app;
+	add_commands(app);
+	TempDir dir;
+	// timings are printed to stderr, output of the pipeline isn't changed
+	auto check = [&](const CLI::String& line, CLI::StringView output, std::initializer_list<CLI::StringView> reported, int code = 0) {
+		CLI::String printed;
+		CLI::String errors = captured(STDERR_FILENO, [&]() {
+			printed = captured(STDOUT_FILENO, [&]() { app.runLine(line); });
+		});
+		bool found = std::ranges::all_of(reported, [&](CLI::StringView text) { return errors.find(text) != CLI::String::npos; });
+		failures += expect(printed == output && found && app.returnCode() == code,
+			fmt::format("{:?} printed {:?} = {}, reported\n{}", line, printed, app.returnCode(), errors));
+	};
+	check("time emit a | upper", "A\n", { "real ", "user ", "sys ", "stage", "emit a", "upper" });
+	check("time fail || emit b", "b\n", { "real ", "fail " });
+	check("emit c && time !echo x | count", "c\n1\n", { "!echo x", "count" });
+	// output of the runs of `profile` is discarded, unless it's redirected
+	check("profile -n 3 emit a | upper", "", { "3 runs", "p50", "p99", "emit a", "upper" });
+	check(fmt::format("profile -n 2 emit a >> {}", dir / "runs.txt"), "", { "2 runs" });
+	check(fmt::format("count < {}", dir / "runs.txt"), "2\n", {});
+
+	const Check checks[] = {
+		{ "emit a | time upper", "\"time\" can only be used at the start of a pipeline", any_code, true },
+		{ "time", "missing command after \"time\"", any_code, true },
+		{ "profile -n 0 emit a", "\"profile\" needs a positive number of runs after \"-n\"", any_code, true },
+	};
+	failures += run_checks(app, checks);
+	return failures;
+}
+
+static int test_cache()
+{
+	int failures = 0;
+	// `tally` prints its arguments and the number of lines it reads, `tally fail ...` returns 1
+	int calls = 0;
+	auto add_tally = [&calls](CLI::CLI& app) {
+		add_commands(app);
+		app.insertCommand("tally", [&calls](CLI::CLI& cli, const CLI::ArgList& args) {
+			calls++;
+			CLI::String line;
+			int lines = 0;
+			while (cli.getline(line))
+				lines++;
+			cli.print("{} {}\n", fmt::join(args.begin() + 1, args.end(), " "), lines);
+			return args.size() > 1 && args[1] == "fail" ? 1 : 0;
+		});
+		app.command("tally")->setPure();
+	};
+	auto check = [&](CLI::CLI& app, const Check& line, int expected_calls) {
+		failures += run_checks(app, std::span(&line, 1));
+		failures += expect(calls == expected_calls, fmt::format("{:?} called tally {} times, not {}", line.line, calls, expected_calls));
+	};
+
+	CLI::CLI app;
+	add_tally(app);
+	check(app, { "tally a", "a 0\n" }, 1);
+	check(app, { "tally a", "a 0\n" }, 1);
+	check(app, { "tally a | upper", "A 0\n" }, 1);
+	check(app, { "tally b", "b 0\n" }, 2);
+	check(app, { "emit x y | tally a", "a 2\n" }, 3);
+	check(app, { "emit x y | tally a", "a 2\n" }, 3);
+	check(app, { "emit x z | tally a", "a 2\n" }, 4);
+	check(app, { "emit x | tally a", "a 1\n" }, 5);
+	// failures aren't kept
+	check(app, { "tally fail", "fail 0\n", 1 }, 6);
+	check(app, { "tally fail", "fail 0\n", 1 }, 7);
+	check(app, { "cache", "pure commands: tally\nentries: 5\n", 0, true }, 7);
+	check(app, { "cache -c emit", "" }, 7);
+	check(app, { "tally a", "a 0\n" }, 7);
+	check(app, { "cache -c tally", "" }, 7);
+	check(app, { "tally a", "a 0\n" }, 8);
+	check(app, { "tally b", "b 0\n" }, 9);
+	check(app, { "cache -c", "" }, 9);
+	check(app, { "cache", "pure commands: tally\nentries: 0\n", 0, true }, 9);
+	check(app, { "tally b", "b 0\n" }, 10);
+
+	// a pure command at the start of a pipeline reads no input, not stdin
+	int fds[2];
+	if (::pipe(fds) != 0)
+		return failures + expect(false, "pipe");
+	bool written = ::write(fds[1], "x\ny\n", 4) == 4;
+	::close(fds[1]);
+	int saved = ::dup(STDIN_FILENO);
+	::dup2(fds[0], STDIN_FILENO);
+	::close(fds[0]);
+	check(app, { "tally head", "head 0\n" }, 11);
+	::dup2(saved, STDIN_FILENO);
+	::close(saved);
+	failures += expect(written, "input written to stdin");
+
+	// least recently used outputs are evicted first, the cache holds two outputs of `tally`
+	std::size_t entry_size = 0;
+	{
+		auto measure = std::make_shared<CLI::OutputCache>();
+		CLI::CLI session;
+		add_tally(session);
+		session.setOutputCache(measure);
+		captured(STDOUT_FILENO, [&]() { session.runLine("tally a"); });
+		entry_size = measure->statistics().bytes;
+	}
+	calls = 0;
+	CLI::CLI small;
+	add_tally(small);
+	small.setOutputCache(std::make_shared<CLI::OutputCache>(2 * entry_size));
+	check(small, { "tally a", "a 0\n" }, 1);
+	check(small, { "tally b", "b 0\n" }, 2);
+	check(small, { "tally a", "a 0\n" }, 2);
+	check(small, { "tally c", "c 0\n" }, 3);
+	check(small, { "tally a", "a 0\n" }, 3);
+	check(small, { "tally b", "b 0\n" }, 4);
+	failures += expect(small.outputCache()->statistics().entries == 2, "entries after eviction");
+
+	// without a cache pure commands run every time, like any other command
+	small.setOutputCache(nullptr);
+	check(small, { "emit x | tally a", "a 1\n" }, 5);
+	check(small, { "emit x | tally a", "a 1\n" }, 6);
+	check(small, { "cache", "", 1 }, 6);
+	return failures;
+}
+
+static int test_typed_arguments()
+{
+	CLI::CLI app;
+	CLI::Option<int>* count = nullptr;
+	CLI::Option<bool>* upper = nullptr;
+	CLI::PositionalArgument<CLI::String>* text = nullptr;
+	app.insertCommand("repeat", [&](CLI::CLI& cli, const CLI::ArgList&) {
+		CLI::String line = cli.argument(text).get();
+		if (cli.argument(upper).get())
+			std::ranges::transform(line, line.begin(), [](char c) { return char(std::toupper(c)); });
+		for (int i = 0; i < cli.argument(count).get(); i++)
+			cli.print("{}\n", line);
+		return 0;
+	});
+	CLI::ArgParser& args = app.command("repeat")->arguments();
+	count = args.addOption<int>("count", 'n', 1);
+	upper = args.addFlag("upper", 'u');
+	text = args.addPositional<CLI::String>("text", "none");
+
+	// values left out of a call are the defaults, whatever the last call was given
+	const Check checks[] = {
+		{ "repeat -n 3 hi", "hi\nhi\nhi\n" },
+		{ "repeat bye", "bye\n" },
+		{ "repeat -u -n 2 up", "UP\nUP\n" },
+		{ "repeat low", "low\n" },
+		{ "repeat", "none\n" },
+		{ "repeat -n 2 x |> (repeat a, repeat -u -n 2 b)", "a\nB\nB\n" },
+		{ "repeat -n 3 x | pmap -j 3 repeat -n 2 y", "y\ny\ny\ny\ny\ny\n" },
+		{ "repeat -n x y", "repeat: invalid value for --count", any_code, true },
+		{ "repeat again", "again\n" },
+	};
+	return run_checks(app, checks);
+}
+
+/** @brief Run lines through sessions and compare what they print with what's expected. */
+int run_behaviour_tests()
+{
+	int failures = 0;
+	failures += test_external_stages();
+	failures += test_redirections();
+	failures += test_jobs();
+	failures += test_fan_out();
+	failures += test_pmap();
+	failures += test_line_sources();
+	failures += test_sessions();
+	failures += test_server();
+	failures += test_history();
+	failures += test_suggestions();
+	failures += test_metrics();
+#if CLIPP_ENABLE_TRACING
+	failures += test_tracing();
+#endif
+	failures += test_timing();
+	failures += test_cache();
+	failures += test_typed_arguments();
+	if (failures == 0)
+		fmt::print("all behaviour tests passed\n");
+	return failures;
+}
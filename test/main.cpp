@@ -1,8 +1,19 @@
 #include "../include/CLI++/CLI++.hpp"
+#include "../include/CLI++/Server.hpp"
+#include <charconv>
 #include <filesystem>
 
 SET_CLIPP_ALIAS(CLI);
 
+// allocations.cpp
+int run_allocation_tests();
+// argparser_bench.cpp
+int run_argparser_bench(int iterations);
+// behaviour.cpp
+int run_behaviour_tests();
+// argparser_tests.cpp
+int run_argparser_tests();
+
 int main(int argc, const char** argv)
 {
 	CLI::String name{"USER"};
@@ -49,6 +60,32 @@ int main(int argc, const char** argv)
 		return 0;
 	} , "test 1");
 
+	// output of `sum` depends only on its arguments, so it can be cached
+	app.insertCommand("sum", [](CLI::CLI& cli, const CLI::ArgList& args) {
+		long long total = 0;
+		for (std::size_t i = 1; i < args.size(); i++)
+		{
+			long long value = 0;
+			std::from_chars(args[i].data(), args[i].data() + args[i].size(), value);
+			total += value;
+		}
+		cli.print("{}\n", total);
+		return 0;
+	}, "print the sum of integer arguments");
+	app.command("sum")->setPure();
+
+	// arguments of `repeat` are parsed by CLI before it's called
+	CLI::Option<int>* repeat_count = nullptr;
+	CLI::PositionalArgument<CLI::String>* repeat_text = nullptr;
+	app.insertCommand("repeat", [&](CLI::CLI& cli, const CLI::ArgList&) {
+		for (int i = 0; i < cli.argument(repeat_count).get(); i++)
+			cli.print("{}\n", cli.argument(repeat_text).get());
+		return 0;
+	}, "print a text several times");
+	CLI::ArgParser& repeat_args = app.command("repeat")->arguments();
+	repeat_count = repeat_args.addOption<int>("count", 'n', 1, "number of times to print it");
+	repeat_text = repeat_args.addPositional<CLI::String>("text", "", "text to print")->setRequired(true);
+
 	app.insertCommand("ret0", [](CLI::CLI&, const CLI::ArgList& args) {
 		fmt::print("return 0;\n");
 		return 0;
@@ -58,6 +95,55 @@ int main(int argc, const char** argv)
 		return 1;
 	} , "return 1");
 
+	for (int i = 1; i < argc; i++)
+	{
+		CLI::StringView arg = argv[i];
+		// `--listen <socket path>` serves the commands above to clients of a Unix domain socket
+		if (arg == "--listen" && i + 1 < argc)
+		{
+			CLI::CLIServer server(app.shareCommands());
+			server.listenUnix(argv[++i]);
+			server.run();
+			return 0;
+		}
+		// `--alloc-test` checks that running simple lines doesn't allocate, see allocations.cpp
+		else if (arg == "--alloc-test")
+			return run_allocation_tests() == 0 ? 0 : 1;
+		// `--behaviour-test` runs scripted lines and checks their output, see behaviour.cpp
+		else if (arg == "--behaviour-test")
+			return run_behaviour_tests() == 0 ? 0 : 1;
+		// `--argparser-test` checks what ArgParser parses and the errors it reports, see argparser_tests.cpp
+		else if (arg == "--argparser-test")
+			return run_argparser_tests() == 0 ? 0 : 1;
+		// `--argparser-bench [N]` times N parses of ArgParser against getopt_long, see argparser_bench.cpp
+		else if (arg == "--argparser-bench")
+			return run_argparser_bench(i + 1 < argc ? std::atoi(argv[i + 1]) : 200000);
+		// `--stdin` reads raw lines from stdin instead of readline, e.g. to run scripts through a pipe
+		else if (arg == "--stdin")
+			app.setLineSource(std::make_unique<CLI::StdinLineSource>());
+		// `--history <file>` keeps command history in a file, and suggests lines from it
+		else if (arg == "--history" && i + 1 < argc)
+		{
+			app.setHistory(std::make_shared<CLI::History>(argv[++i]));
+			app.setSuggestions(std::make_shared<CLI::SuggestionModel>());
+		}
+#if CLIPP_ENABLE_TRACING
+		// `--trace` prints every trace event to stderr, with microseconds since the first one
+		else if (arg == "--trace")
+		{
+			app.addTraceHook([start = std::uint64_t(0)](const CLI::CLI&, const CLI::TraceEvent& event) mutable {
+				constexpr const char* kinds[] = { "parse", "pipeline", "command" };
+				if (start == 0)
+					start = event.timestamp;
+				bool begin = event.phase == CLI::TraceEvent::Phase::Begin;
+				fmt::print(stderr, "{:>10.3f} {} {:<8} {}.{} {:?}{}\n", double(event.timestamp - start) / 1000,
+					begin ? '>' : '<', kinds[int(event.kind)], event.pipeline, event.stage, event.name,
+					begin ? CLI::String() : fmt::format(" = {}", event.return_code));
+			});
+		}
+#endif
+	}
+
 	int ret = app.exec();
 	fmt::print("CLI returned with code: {}\n", ret);
 	return ret;